@@ -0,0 +1,339 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+
+/* Batched reads for widgets that sample lots of small files on kept
+   fds (sysfs values, cgroup files, /proc/pid/stat).
+
+   Widgets queue their reads with queue_read(), then run_batch() gets
+   them all done and fills in the results. With io_uring, that is one
+   io_uring_enter per RING reads instead of one pread each. Without it
+   (old kernel, seccomp, io_uring_disabled) the same queue just gets
+   pread in a loop, so the widgets do not care which one is in use.
+
+   All reads are at offset 0 into a buffer owned by the caller, and
+   the data gets NUL-terminated, so size must have room for that.
+
+   A ring is only used if the kernel says it can do IORING_OP_READ.
+   Should a read still come back with EINVAL or EOPNOTSUPP, that read
+   gets redone with pread and the ring is dropped for good. */
+
+#define RING 64
+#define MAXREQ 256
+
+static struct readreq* queue[MAXREQ];
+static uint nqueued;
+
+static struct ring {
+	int fd;
+	uint* sqhead;
+	uint* sqtail;
+	uint* sqmask;
+	uint* sqarray;
+	uint* cqhead;
+	uint* cqtail;
+	uint* cqmask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sqmap;
+	size_t sqsize;
+	size_t sqesize;
+} ring = { .fd = -1 };
+
+static byte inflight[MAXREQ];
+
+static uint tried;
+static uint broken;
+
+static void* map_ring(int fd, size_t size, off_t off)
+{
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                 MAP_SHARED | MAP_POPULATE, fd, off);
+
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/* The probe came in 5.6 along with IORING_OP_READ, so a ring that
+   cannot be probed cannot do reads either. The kernel wants the probe
+   zeroed. */
+
+static int can_read(int fd)
+{
+	char buf[sizeof(struct io_uring_probe)
+	         + (IORING_OP_READ + 1)*sizeof(struct io_uring_probe_op)]
+	         __attribute__((aligned(8)));
+	struct io_uring_probe* pb = (void*)buf;
+	struct io_uring_probe_op* op = &pb->ops[IORING_OP_READ];
+
+	memset(buf, 0, sizeof(buf));
+
+	if(syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE,
+	           pb, IORING_OP_READ + 1) < 0)
+		return 0;
+	if(pb->last_op < IORING_OP_READ)
+		return 0;
+
+	return op->flags & IO_URING_OP_SUPPORTED;
+}
+
+static void open_ring(void)
+{
+	struct io_uring_params p;
+	size_t sqsize, cqsize;
+	char *sq, *cq;
+	void* sqes;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+
+	if((fd = syscall(SYS_io_uring_setup, RING, &p)) < 0)
+		return;
+	if(!(p.features & IORING_FEAT_SINGLE_MMAP))
+		goto close; /* pre-5.4, not worth the extra mapping */
+	if(!can_read(fd))
+		goto close;
+
+	sqsize = p.sq_off.array + p.sq_entries*sizeof(uint);
+	cqsize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+
+	if(cqsize > sqsize)
+		sqsize = cqsize;
+
+	if(!(sq = map_ring(fd, sqsize, IORING_OFF_SQ_RING)))
+		goto close;
+	if(!(sqes = map_ring(fd, p.sq_entries*sizeof(struct io_uring_sqe),
+	                     IORING_OFF_SQES)))
+		goto unmap;
+
+	cq = sq;
+
+	ring.fd = fd;
+	ring.sqhead = (uint*)(sq + p.sq_off.head);
+	ring.sqtail = (uint*)(sq + p.sq_off.tail);
+	ring.sqmask = (uint*)(sq + p.sq_off.ring_mask);
+	ring.sqarray = (uint*)(sq + p.sq_off.array);
+	ring.cqhead = (uint*)(cq + p.cq_off.head);
+	ring.cqtail = (uint*)(cq + p.cq_off.tail);
+	ring.cqmask = (uint*)(cq + p.cq_off.ring_mask);
+	ring.sqes = sqes;
+	ring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	ring.sqmap = sq;
+	ring.sqsize = sqsize;
+	ring.sqesize = p.sq_entries*sizeof(struct io_uring_sqe);
+
+	return;
+unmap:
+	munmap(sq, sqsize);
+close:
+	close(fd);
+}
+
+/* The mappings hold a reference to the ring, closing the fd alone
+   would not free it. */
+
+static void drop_ring(void)
+{
+	munmap(ring.sqes, ring.sqesize);
+	munmap(ring.sqmap, ring.sqsize);
+	close(ring.fd);
+	ring.fd = -1;
+}
+
+static void read_sync(struct readreq* rq)
+{
+	int ret = pread(rq->fd, rq->buf, rq->size - 1, 0);
+
+	rq->ret = ret < 0 ? -errno : ret;
+
+	iostats.syscalls++;
+
+	if(ret >= 0)
+		rq->buf[ret] = '\0';
+	if(ret > 0)
+		iostats.bytes += ret;
+}
+
+void queue_read(struct readreq* rq, int fd, char* buf, uint size)
+{
+	rq->fd = fd;
+	rq->buf = buf;
+	rq->size = size;
+	rq->ret = -EAGAIN;
+
+	if(nqueued < MAXREQ)
+		queue[nqueued++] = rq;
+	else
+		read_sync(rq);
+}
+
+static void prep_read(uint idx)
+{
+	struct readreq* rq = queue[idx];
+	uint tail = *ring.sqtail;
+	uint i = tail & *ring.sqmask;
+	struct io_uring_sqe* sqe = &ring.sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = rq->fd;
+	sqe->addr = (unsigned long)rq->buf;
+	sqe->len = rq->size - 1;
+	sqe->off = 0;
+	sqe->user_data = idx;
+
+	ring.sqarray[i] = i;
+	inflight[idx] = 1;
+
+	__atomic_store_n(ring.sqtail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static uint reap_reads(void)
+{
+	uint head = *ring.cqhead;
+	uint tail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE);
+	uint n = 0;
+
+	for(; head != tail; head++, n++) {
+		struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqmask];
+		struct readreq* rq = queue[cqe->user_data];
+		int res = cqe->res;
+
+		inflight[cqe->user_data] = 0;
+
+		if(res == -EINVAL || res == -EOPNOTSUPP) {
+			broken = 1;
+			read_sync(rq);
+			continue;
+		}
+
+		rq->ret = res;
+
+		if(res >= 0)
+			rq->buf[res] = '\0';
+		if(res > 0)
+			iostats.bytes += res;
+	}
+
+	__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+static int enter_ring(uint submit, uint wait)
+{
+	int ret = syscall(SYS_io_uring_enter, ring.fd, submit, wait,
+	                  IORING_ENTER_GETEVENTS, NULL, 0);
+
+	iostats.syscalls++;
+
+	if(ret >= 0)
+		return ret;
+
+	/* signal, or no room for completions yet */
+	if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+		return 0;
+
+	return -1;
+}
+
+/* The ring failed with reads still in flight. The kernel may write into
+   their buffers until they complete, so they get waited for before
+   anything else happens to them. Should waiting fail as well, whatever
+   is still in flight gets an error and is not read again. */
+
+static void drain_chunk(uint first, uint sent, uint got)
+{
+	uint i;
+
+	while(got < sent) {
+		if(enter_ring(0, sent - got) < 0)
+			break;
+
+		got += reap_reads();
+	}
+
+	for(i = first; i < first + sent; i++) {
+		if(!inflight[i])
+			continue;
+
+		inflight[i] = 0;
+		queue[i]->ret = -EIO;
+	}
+}
+
+/* Requests go in chunks of RING. Returns the number of requests from
+   the chunk that the kernel took, and all of those have their results
+   by then. Anything less than n means the ring has failed, and the rest
+   of the queue is left to be done the slow way. */
+
+static uint run_chunk(uint first, uint n)
+{
+	uint left = n, got = 0;
+	int ret;
+
+	for(uint i = 0; i < n; i++)
+		prep_read(first + i);
+
+	while(got < n) {
+		if((ret = enter_ring(left, n - got)) < 0)
+			break;
+
+		left -= ret;
+		got += reap_reads();
+	}
+
+	if(got < n)
+		drain_chunk(first, n - left, got);
+
+	return n - left;
+}
+
+/* A chunk with unsupported reads in it is complete by the time it
+   returns, but nothing after it goes to the ring. */
+
+static uint run_ring(void)
+{
+	uint done = 0;
+
+	while(done < nqueued) {
+		uint n = nqueued - done;
+		uint sent;
+
+		if(n > RING) n = RING;
+
+		sent = run_chunk(done, n);
+
+		done += sent;
+
+		if(sent < n || broken) {
+			drop_ring();
+			break;
+		}
+	}
+
+	return done;
+}
+
+void run_batch(void)
+{
+	uint i, done = 0;
+
+	if(!tried) {
+		tried = 1;
+		open_ring();
+	}
+
+	if(ring.fd >= 0)
+		done = run_ring();
+
+	for(i = done; i < nqueued; i++)
+		read_sync(queue[i]);
+
+	nqueued = 0;
+}
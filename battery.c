@@ -3,21 +3,11 @@
 
 #include "common.h"
 
-#include "xbm/s0.xbm"
-#include "xbm/s1.xbm"
-#include "xbm/s2.xbm"
-#include "xbm/s3.xbm"
-#include "xbm/s4.xbm"
-#include "xbm/s5.xbm"
-#include "xbm/s6.xbm"
-#include "xbm/s7.xbm"
-#include "xbm/s8.xbm"
-#include "xbm/s9.xbm"
-#include "xbm/sc.xbm"
-
-#define W 60
-#define H 20
-#define B 2
+/* Geometry is given at scale 1, S is one scaled pixel */
+
+#define S scale
+#define W (60*S)
+#define H (20*S)
 
 #define INACTIVE 0
 #define CHARGING 1
@@ -30,33 +20,6 @@ static uint bat_charge_prev;
 static uint bat_charge_now;
 static uint bat_current_now;
 
-#define XBM(name) { name##_bits, name##_width, name##_height }
-
-static const struct bitmap {
-	byte* data;
-	int w;
-	int h;
-} bitmaps[] = {
-	XBM(s0),
-	XBM(s1),
-	XBM(s2),
-	XBM(s3),
-	XBM(s4),
-	XBM(s5),
-	XBM(s6),
-	XBM(s7),
-	XBM(s8),
-	XBM(s9),
-	XBM(sc),
-};
-
-static void draw_xbm(uint idx)
-{
-	const struct bitmap* bm = &bitmaps[idx];
-
-	bitmap(bm->data, bm->w, bm->h);
-}
-
 static char* prefix(char* p, char* pre)
 {
 	uint len = strlen(pre);
@@ -119,42 +82,26 @@ static void parse_bat_info(void)
 	}
 }
 
-static void fillrec(uint x, uint y, uint w, uint h)
-{
-	uint i, j;
-
-	for(j = 0; j < h; j++) {
-		for(i = 0; i < w; i++) {
-			point(x + i, y + j);
-		}
-	}
-}
-
-static void hline(uint x, uint y, uint dx)
+static void draw_bat_border(void)
 {
-	uint i;
-
-	for(i = 0; i < dx; i++)
-		point(x + i, y);
-}
+	setcolor(0x888888);
 
-static void vline(uint x, uint y, uint dy)
-{
-	uint i;
+	fillrec(2*S, 2*S, W - 4*S, S);
+	fillrec(2*S, H - 3*S, W - 4*S, S);
 
-	for(i = 0; i < dy; i++)
-		point(x, y + i);
+	fillrec(2*S, 2*S, S, H - 4*S);
+	fillrec(W - 3*S, 2*S, S, H - 4*S);
 }
 
-static void draw_bat_border(void)
+static uint charge_width(uint bw)
 {
-	setcolor(0x888888);
+	uint full = bat_charge_full / 1000;
+	uint now = bat_charge_now / 1000;
 
-	hline(2, 2, W - 4);
-	hline(2, H - 3, W - 4);
+	if(!full)
+		return 0;
 
-	vline(2, 2, H - 4);
-	vline(W - 3, 2, H - 4);
+	return (bw*now) / full; /* [0..bw] */
 }
 
 static void draw_bat_charge(void)
@@ -164,15 +111,12 @@ static void draw_bat_charge(void)
 	else
 		setcolor(0x007000);
 
-	uint full = bat_charge_full / 1000;
-	uint now = bat_charge_now / 1000;
-
-	uint ox = 3;
-	uint oy = 3;
+	uint ox = 3*S;
+	uint oy = 3*S;
 	uint bw = W - 2*ox;
 	uint bh = H - 2*oy;
 
-	uint charge = (bw*now) / full; /* [0..bw] */
+	uint charge = charge_width(bw);
 	uint empty = bw - charge;
 
 	fillrec(ox + empty, oy, bw - empty, bh);
@@ -204,56 +148,44 @@ static char* format_time(uint blh, uint blm)
 
 static uint align_time(char* str)
 {
-	char* p = str;
-	uint w = 0;
-	char c;
-
-	while((c = *p++)) {
-		if(c >= '0' && c <= '9')
-			w += bitmaps[0].w;
-		else
-			w += bitmaps[10].w;
-
-	}
+	uint w = small_width(str);
 
 	if(w > W) return 0;
 
 	return W/2 - w/2;
 }
 
-static void draw_string(char* str)
+/* Minutes left, or -1 if there is no estimate to show. */
+
+static int estimate(void)
 {
-	char* p = str;
-	char c;
+	if(bat_status != DISCHARGING)
+		return -1;
+	if(bat_current_now < 10000) /* 10mA? */
+		return -1;
 
-	while((c = *p++)) {
-		if(c >= '0' && c <= '9')
-			draw_xbm(c - '0');
-		else
-			draw_xbm(10);
-	}
+	return 60*bat_charge_now / bat_current_now;
 }
 
 static void draw_bat_estime(void)
 {
-	if(bat_status != DISCHARGING)
-		return;
-	if(bat_current_now < 10000) /* 10mA? */
+	int bt = estimate();
+
+	if(bt < 0)
 		return;
 
-	uint bt = 60*bat_charge_now / bat_current_now;
 	uint blh = bt / 60;
 	uint blm = bt % 60;
 
 	char* str = format_time(blh, blm);
 
 	uint x = align_time(str);
-	uint y = 4;
+	uint y = 4*S;
 
 	setcolor(0xFFFFFF);
 	moveto(x, y);
 
-	draw_string(str);
+	small_string(str);
 }
 
 static void redraw_battery(void)
@@ -263,7 +195,7 @@ static void redraw_battery(void)
 	if(!bat_charge_full)
 		return;
 
-	advance(5);
+	advance(5*S);
 
 	draw_bat_border();
 
@@ -271,10 +203,22 @@ static void redraw_battery(void)
 
 	draw_bat_estime();
 
-	advance(W + 5);
+	advance(W + 5*S);
 }
 
-void put_battery(void)
+static void export_battery(void)
+{
+	xps.bat_status = bat_status;
+	xps.bat_charge = 0;
+	xps.bat_minutes = 0;
+
+	if(bat_charge_full)
+		xps.bat_charge = 1000ULL*bat_charge_now/bat_charge_full;
+	if(bat_status == DISCHARGING && bat_current_now >= 10000)
+		xps.bat_minutes = 60ULL*bat_charge_now/bat_current_now;
+}
+
+void update_battery(void)
 {
 	if(!bat_disabled)
 		;
@@ -283,10 +227,29 @@ void put_battery(void)
 
 	if(load_file("/sys/class/power_supply/BAT0/uevent") < 0) {
 		bat_disabled = 1;
+		bat_status = INACTIVE;
+		export_battery();
 		return;
 	}
 
 	parse_bat_info();
+	export_battery();
+}
+
+/* Everything redraw_battery() looks at. The charge changes maybe once
+   a minute, and only moves the bar when it crosses a pixel. */
+
+uint64_t key_battery(void)
+{
+	if(bat_status == INACTIVE || !bat_charge_full)
+		return 0;
+
+	uint64_t charge = charge_width(W - 6*S);
+
+	return (uint64_t)bat_status << 48 | charge << 32 | (uint32_t)estimate();
+}
 
+void put_battery(void)
+{
 	redraw_battery();
 }
@@ -0,0 +1,9 @@
+/* Shared bits of the benchmarks, see harness.c */
+
+#define MAXBENCHW 2000
+#define MAXBENCHH 80
+
+uint64_t nanotime(void);
+uint64_t cputime(void);
+
+void report(const char* what, uint64_t ns, uint n);
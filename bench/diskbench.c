@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+#include "../diskload.c"
+#include "bench.h"
+
+/* parse_diskstats() on a large made-up diskstats: 256 loop devices and
+   64 NVMe drives with 3 partitions each, 512 lines in total. Most of
+   them get skipped, which is the point. A file given on the command line
+   gets used instead, /proc/diskstats for instance. */
+
+#define RUNS 20000
+
+static struct buffer fixture;
+
+static void make_fixture(void)
+{
+	char* p;
+	uint i, j, size = 512*128;
+
+	if(!(p = fixture.data = malloc(size)))
+		err(-1, "malloc");
+
+	for(i = 0; i < 256; i++)
+		p += sprintf(p, "   7 %7u loop%u 120 0 2400 30 0 0 0 0 0 40 30"
+				" 0 0 0 0 0 0\n", i, i);
+
+	for(i = 0; i < 64; i++) {
+		p += sprintf(p, " 259 %7u nvme%un1 123456 789 98765432 4321"
+				" 55555 666 7777777 888 0 99999 12345 0 0 0 0 0 0\n",
+				8*i, i);
+
+		for(j = 1; j <= 3; j++)
+			p += sprintf(p, " 259 %7u nvme%un1p%u 1234 7 987654 432"
+					" 555 66 77777 88 0 999 1234 0 0 0 0 0 0\n",
+					8*i + j, i, j);
+	}
+
+	fixture.len = p - fixture.data;
+	fixture.size = size;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t t0, total = 0;
+	uint i, used = 0, skip = 0;
+
+	if(argc > 1)
+		load_buffer(argv[1], &fixture);
+	else
+		make_fixture();
+
+	if(!fixture.len)
+		errx(-1, "no data");
+	if(!(diskbuf.data = malloc(fixture.len + 1)))
+		err(-1, "malloc");
+
+	/* the parser cuts lines in place, so every run gets a fresh copy */
+
+	for(i = 0; i < RUNS; i++) {
+		memcpy(diskbuf.data, fixture.data, fixture.len);
+		diskbuf.data[fixture.len] = '\0';
+		diskbuf.len = fixture.len;
+
+		t0 = nanotime();
+		generation++;
+		memset(&sum, 0, sizeof(sum));
+		parse_diskstats();
+		total += nanotime() - t0;
+	}
+
+	for(i = 0; i < NSLOTS; i++) {
+		if(!devs[i].used)
+			continue;
+
+		used++;
+		skip += devs[i].skip;
+	}
+
+	printf("%u bytes, %u devices, %u skipped, %u counted\n",
+			fixture.len, used, skip, sum.count);
+
+	report("parse_diskstats", total, RUNS);
+
+	return 0;
+}
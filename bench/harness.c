@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "bench.h"
+
+/* Stand-ins for the globals panel.c, stats.c and export.c provide, so that
+   widgets can be linked without X. The image is plain memory large
+   enough for the benchmarks, pix_height is left for them to set. */
+
+static byte img[MAXBENCHW*MAXBENCHH*4];
+
+uint pix_width = MAXBENCHW;
+uint pix_height = 20;
+uint pix_wused;
+uint scale = 1;
+byte* image = img;
+uint pix_bytes = 4;
+uint dtms = 500;
+
+char databuf[2048];
+uint datalen;
+
+struct sample sample;
+struct iostats iostats;
+struct xpstat xps;
+
+void add_source(int fd, uint events, void (*call)(void* data, uint events),
+                void* data)
+{
+	/* nothing gets polled here */
+}
+
+static uint64_t clockns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t nanotime(void)
+{
+	return clockns(CLOCK_MONOTONIC);
+}
+
+/* CPU time of the whole process, kernel side included. Sleeps between
+   ticks do not count. */
+
+uint64_t cputime(void)
+{
+	return clockns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void report(const char* what, uint64_t ns, uint n)
+{
+	double avg = (double)ns / n;
+
+	if(avg >= 10000)
+		printf("%-24s %8.1f us\n", what, avg/1000);
+	else
+		printf("%-24s %8.0f ns\n", what, avg);
+}
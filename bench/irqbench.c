@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "../irqload.c"
+#include "bench.h"
+
+/* update_irqload() on a made-up /proc/interrupts of a 256-CPU machine,
+   192 numbered IRQs plus the usual arch lines, some 500KB. The stream
+   alone gets timed as well, to see how much of it is just read() and
+   line splitting. A file given on the command line gets used instead. */
+
+#define RUNS 500
+#define NCPUS 256
+#define NIRQS 192
+
+static const char* archirqs[] = {
+	"LOC", "RES", "CAL", "TLB", "TRM", "THR", "DFR", "MCE", "MCP"
+};
+
+static void put_counts(FILE* fp)
+{
+	for(uint i = 0; i < NCPUS; i++)
+		fprintf(fp, " %10u", (uint)random() % 1000000);
+}
+
+static char* make_fixture(void)
+{
+	static char path[] = "/tmp/irqbench.XXXXXX";
+	uint i, n = sizeof(archirqs)/sizeof(*archirqs);
+	FILE* fp;
+	int fd;
+
+	if((fd = mkstemp(path)) < 0 || !(fp = fdopen(fd, "w")))
+		err(-1, "%s", path);
+
+	fprintf(fp, "     ");
+	for(i = 0; i < NCPUS; i++)
+		fprintf(fp, "      CPU%-4u", i);
+	fprintf(fp, "\n");
+
+	for(i = 0; i < NIRQS; i++) {
+		fprintf(fp, "%4u:", i);
+		put_counts(fp);
+		fprintf(fp, "  IR-PCI-MSI %u-edge      eth0-TxRx-%u\n", 1234 + i, i);
+	}
+
+	for(i = 0; i < n; i++) {
+		fprintf(fp, " %s:", archirqs[i]);
+		put_counts(fp);
+		fprintf(fp, "   Something\n");
+	}
+
+	fprintf(fp, " ERR:          0\n");
+	fprintf(fp, " MIS:          0\n");
+
+	if(fclose(fp))
+		err(-1, "%s", path);
+
+	return path;
+}
+
+int main(int argc, char** argv)
+{
+	char* path = argc > 1 ? argv[1] : make_fixture();
+	uint64_t t0, t1;
+	uint i;
+
+	if(open_stream(&irqst, path) < 0)
+		err(-1, "%s", path);
+	if(argc <= 1)
+		unlink(path);
+
+	update_irqload();
+	update_irqload();
+
+	printf("%u CPUs in %u columns of %u, %u rows, %u on top\n",
+			ncols, ngroups, grpsize, nrows, ntop);
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++) {
+		rewind_stream(&irqst);
+
+		while(next_line(&irqst))
+			;
+	}
+	t1 = nanotime();
+
+	report("stream only", t1 - t0, RUNS);
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++)
+		update_irqload();
+	t1 = nanotime();
+
+	report("update_irqload", t1 - t0, RUNS);
+
+	return 0;
+}
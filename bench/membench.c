@@ -0,0 +1,44 @@
+#include <stdio.h>
+
+#include "../memory.c"
+#include "bench.h"
+
+/* Parsing cost of the live /proc/meminfo and /proc/vmstat, and of the
+   whole update_memory() which reads both of them as well. */
+
+#define RUNS 20000
+
+int main(void)
+{
+	uint64_t t0, t1;
+	uint i;
+
+	update_memory();
+	update_memory();
+
+	printf("meminfo %u bytes, vmstat %u bytes\n",
+			meminfo_buf.len, vmstat_buf.len);
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++)
+		update_memory();
+	t1 = nanotime();
+
+	report("update_memory", t1 - t0, RUNS);
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++)
+		parse_fields(&vmstat_buf, vmstat_fields, NFIELDS(vmstat_fields));
+	t1 = nanotime();
+
+	report("vmstat parse", t1 - t0, RUNS);
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++)
+		parse_fields(&meminfo_buf, meminfo_fields, NFIELDS(meminfo_fields));
+	t1 = nanotime();
+
+	report("meminfo parse", t1 - t0, RUNS);
+
+	return 0;
+}
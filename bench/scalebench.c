@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "common.h"
+#include "bench.h"
+
+/* Rendering cost of a few widgets at a given integer scale, per frame
+   and per pixel. Glyphs get pre-scaled and graphs drawn at the full
+   height, so the per-pixel cost should stay about the same at any
+   scale. The graphs get filled first, CPU load with made-up values
+   through history.c, memory with some ticks of live data.
+
+       scalebench [scale] */
+
+#define RUNS 20000
+
+/* Without HOME, history stays in memory and the panel's own file
+   does not get touched. */
+
+static void fill_history(void)
+{
+	uint i, c;
+
+	unsetenv("XDG_CACHE_HOME");
+	unsetenv("HOME");
+
+	init_history();
+
+	xps.ncpus = 4;
+
+	for(i = 0; i < 120; i++) {
+		for(c = 0; c < 4; c++)
+			xps.cpuload[c] = (37*i + 200*c) % 1000;
+
+		update_history();
+	}
+}
+
+static void render(void)
+{
+	pix_wused = 0;
+
+	key_clock();
+	put_cpuload();
+	put_memory();
+	put_clock();
+	put_seconds();
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t t0, t1;
+	uint i;
+
+	if(argc > 1)
+		scale = atoi(argv[1]);
+	if(scale < 1 || 20*scale > MAXBENCHH)
+		errx(-1, "bad scale");
+
+	pix_height = 20*scale;
+
+	init_digits();
+	init_clock();
+
+	fill_history();
+
+	for(i = 0; i < 20; i++) {
+		update_memory();
+		usleep(20000);
+	}
+
+	render();
+
+	t0 = nanotime();
+	for(i = 0; i < RUNS; i++)
+		render();
+	t1 = nanotime();
+
+	printf("scale %u, %u x %u pixels, %.2f ns/px\n", scale,
+			pix_wused, pix_height,
+			(double)(t1 - t0) / RUNS / (pix_wused*pix_height));
+
+	report("frame", t1 - t0, RUNS);
+
+	return 0;
+}
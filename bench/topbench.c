@@ -0,0 +1,134 @@
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#include "../proctop.c"
+#include "bench.h"
+
+/* update_proctop() with lots of processes around. Forks the given
+   number of idle processes, plus a few busy ones so that there are
+   kept fds to be read in a batch, then runs some ticks dtms apart.
+   It takes two full rounds through /proc for the busy ones to get
+   their fds kept, those are not counted.
+
+   The time is CPU time of this process, kernel side included, so that
+   sleeping between ticks does not count. Syscalls are only the ones
+   made by run_batch(), per tick, which is where io_uring and pread
+   differ. Option -p makes it use pread only, by failing io_uring_setup
+   the way a kernel without io_uring would; syscall() is wrapped at link
+   time for that.
+
+       topbench [-p] [idle] [busy] */
+
+#define TICKS 20
+
+static pid_t* kids;
+static uint nkids;
+
+static int pread_only;
+
+long __real_syscall(long nr, ...);
+
+long __wrap_syscall(long nr, long a, long b, long c, long d, long e, long f)
+{
+	if(nr == SYS_io_uring_setup && pread_only) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	return __real_syscall(nr, a, b, c, d, e, f);
+}
+
+static void spawn(uint n, int busy)
+{
+	pid_t pid;
+
+	while(n-- > 0) {
+		if((pid = fork()) < 0)
+			err(-1, "fork");
+
+		if(!pid) {
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+			if(busy)
+				for(;;);
+			else
+				pause();
+
+			_exit(0);
+		}
+
+		kids[nkids++] = pid;
+	}
+}
+
+static void tick(void)
+{
+	update_proctop();
+	usleep(dtms*1000);
+}
+
+static void reap(void)
+{
+	for(uint i = 0; i < nkids; i++)
+		kill(kids[i], SIGKILL);
+	for(uint i = 0; i < nkids; i++)
+		waitpid(kids[i], NULL, 0);
+}
+
+int main(int argc, char** argv)
+{
+	uint idle = 500, busy = 8;
+	uint64_t t0, total = 0, calls = 0;
+	uint i;
+
+	if(argc > 1 && !strcmp(argv[1], "-p")) {
+		pread_only = 1;
+		argc--; argv++;
+	}
+
+	if(argc > 1) idle = atoi(argv[1]);
+	if(argc > 2) busy = atoi(argv[2]);
+
+	if(!(kids = calloc(idle + busy, sizeof(*kids))))
+		err(-1, "malloc");
+
+	spawn(idle, 0);
+	spawn(busy, 1);
+
+	dtms = 100;
+
+	init_proctop();
+
+	if(procfd < 0)
+		err(-1, "/proc");
+
+	while(round < 2)
+		tick();
+
+	for(i = 0; i < TICKS; i++) {
+		uint64_t sc = iostats.syscalls;
+
+		t0 = cputime();
+		update_proctop();
+		total += cputime() - t0;
+		calls += iostats.syscalls - sc;
+
+		usleep(dtms*1000);
+	}
+
+	reap();
+
+	printf("%s, %u processes, %u fds kept, %.1f batch syscalls/tick\n",
+			pread_only ? "pread" : "io_uring", nprocs, nfds,
+			(double)calls / TICKS);
+
+	report("update_proctop", total, TICKS);
+
+	return 0;
+}
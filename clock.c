@@ -16,11 +16,7 @@
 
 #define XBM(name) { name##_bits, name##_width, name##_height }
 
-static const struct bitmap {
-	byte* data;
-	int w;
-	int h;
-} bitmaps[] = {
+static struct bitmap bitmaps[] = {
 	XBM(n0),
 	XBM(n1),
 	XBM(n2),
@@ -34,9 +30,16 @@ static const struct bitmap {
 	XBM(nc),
 };
 
+#define NBITMAPS (sizeof(bitmaps)/sizeof(*bitmaps))
+
+void init_clock(void)
+{
+	scale_bitmaps(bitmaps, NBITMAPS);
+}
+
 static void draw_xbm(uint idx)
 {
-	const struct bitmap* bm = &bitmaps[idx];
+	struct bitmap* bm = &bitmaps[idx];
 
 	bitmap(bm->data, bm->w, bm->h);
 }
@@ -47,30 +50,66 @@ static void draw_00(uint v)
 	draw_xbm(v % 10);
 }
 
-void put_clock(void)
+/* HH:MM: and the seconds are two widgets. The first one is keyed on
+   the minute and gets blitted from its tile most of the time, so only
+   the last two digits get drawn on every tick.
+
+   The time gets sampled for the key, and both put functions draw that
+   same value so that the tile always matches its key. */
+
+static time_t now;
+static struct tm tm;
+
+uint64_t key_clock(void)
 {
 	struct timespec ts;
-	int ret;
 
-	if((ret = clock_gettime(CLOCK_REALTIME, &ts)) < 0)
-		return;
+	if(clock_gettime(CLOCK_REALTIME, &ts) < 0)
+		ts.tv_sec = 0;
 
-	struct tm* tm = localtime(&ts.tv_sec);
+	now = ts.tv_sec;
 
+	if(now)
+		localtime_r(&now, &tm);
+
+	return (uint64_t)(now / 60) << 1 | !dtms;
+}
+
+static void set_clock_color(void)
+{
 	if(!dtms)
 		setcolor(0xFFFFFF);
 	else
 		setcolor(0x00A800);
+}
+
+void put_clock(void)
+{
+	if(!now)
+		return;
+
+	set_clock_color();
 
 	moveto(0, 0);
 
-	draw_00(tm->tm_hour);
+	draw_00(tm.tm_hour);
 	draw_xbm(10);
-	draw_00(tm->tm_min);
+	draw_00(tm.tm_min);
 	draw_xbm(10);
-	draw_00(tm->tm_sec);
 
-	uint width = 6*bitmaps[0].w + 2*bitmaps[10].w;
+	advance(4*bitmaps[0].w + 2*bitmaps[10].w);
+}
+
+void put_seconds(void)
+{
+	if(!now)
+		return;
+
+	set_clock_color();
+
+	moveto(0, 0);
+
+	draw_00(tm.tm_sec);
 
-	advance(width);
+	advance(2*bitmaps[0].w);
 }
@@ -1,9 +1,12 @@
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <err.h>
 
 #include "common.h"
+#include "probes.h"
 
 uint color;
 uint cx, cy;
@@ -21,9 +24,75 @@ void advance(uint width)
 	cy = 0;
 }
 
+/* Widgets use 24-bit RGB colors everywhere. Conversion to whatever the
+   visual wants happens here, once per setcolor() call, and point() only
+   stores the ready pixel value. The default is 32-bit xRGB which needs
+   no conversion at all. */
+
+static struct pixfmt {
+	uint native;
+	byte shift[3];
+	byte bits[3];
+} pixfmt = { 1 };
+
+static void mask_bits(uint mask, byte* shift, byte* bits)
+{
+	uint s = 0, b = 0;
+
+	while(mask && !(mask & 1)) {
+		mask >>= 1;
+		s++;
+	}
+	while(mask & 1) {
+		mask >>= 1;
+		b++;
+	}
+
+	*shift = s;
+	*bits = b;
+}
+
+void set_pixfmt(uint rmask, uint gmask, uint bmask, uint bpp)
+{
+	struct pixfmt* pf = &pixfmt;
+
+	pix_bytes = bpp / 8;
+
+	mask_bits(rmask, &pf->shift[0], &pf->bits[0]);
+	mask_bits(gmask, &pf->shift[1], &pf->bits[1]);
+	mask_bits(bmask, &pf->shift[2], &pf->bits[2]);
+
+	pf->native = (bpp == 32 && rmask == 0xFF0000
+	              && gmask == 0x00FF00 && bmask == 0x0000FF);
+}
+
+/* 8-bit channel value to the given number of bits; going wider
+   replicates the top bits so that 0xFF becomes all ones. */
+
+static uint channel(uint v, uint bits)
+{
+	if(bits <= 8)
+		return v >> (8 - bits);
+
+	return (v << (bits - 8)) | (v >> (16 - bits));
+}
+
 void setcolor(uint c)
 {
-	color = c;
+	struct pixfmt* pf = &pixfmt;
+	uint i, v = 0;
+
+	if(pf->native) {
+		color = c;
+		return;
+	}
+
+	for(i = 0; i < 3; i++) {
+		uint ch = (c >> (16 - 8*i)) & 0xFF;
+		v |= channel(ch, pf->bits[i]) << pf->shift[i];
+	}
+
+	color = v;
 }
 
 void point(uint x, uint y)
@@ -37,7 +106,10 @@ void point(uint x, uint y)
 	if(y >= pix_height)
 		return;
 
-	image[y*w + x] = color;
+	if(pix_bytes == 2)
+		((uint16_t*)image)[y*w + x] = color;
+	else
+		((uint32_t*)image)[y*w + x] = color;
 }
 
 void bitmap(byte* data, uint w, uint h)
@@ -63,16 +135,157 @@ void bitmap(byte* data, uint w, uint h)
 	cx += w;
 }
 
+/* Glyphs get scaled once on startup, so that drawing them at 2x or 3x
+   costs the same per pixel as at 1x. Tables that fail to scale are
+   left as they were. */
+
+static byte* scale_xbm(byte* src, uint w, uint h)
+{
+	uint sw = (w + 7)/8;
+	uint nw = w*scale;
+	uint nh = h*scale;
+	uint dw = (nw + 7)/8;
+	uint r, c;
+	byte* dst;
+
+	if(!(dst = calloc(dw*nh, 1)))
+		return NULL;
+
+	for(r = 0; r < nh; r++) {
+		byte* srow = src + (r/scale)*sw;
+		byte* drow = dst + r*dw;
+
+		for(c = 0; c < nw; c++) {
+			uint sc = c/scale;
+
+			if(srow[sc/8] & (1 << (sc % 8)))
+				drow[c/8] |= 1 << (c % 8);
+		}
+	}
+
+	return dst;
+}
+
+void scale_bitmaps(struct bitmap* bm, uint n)
+{
+	byte* data;
+
+	if(scale <= 1)
+		return;
+
+	for(uint i = 0; i < n; i++, bm++) {
+		if(!(data = scale_xbm(bm->data, bm->w, bm->h)))
+			continue;
+
+		bm->data = data;
+		bm->w *= scale;
+		bm->h *= scale;
+	}
+}
+
+void hline(uint x, uint y, uint dx)
+{
+	uint i;
+
+	for(i = 0; i < dx; i++)
+		point(x + i, y);
+}
+
+void vline(uint x, uint y, uint dy)
+{
+	uint i;
+
+	for(i = 0; i < dy; i++)
+		point(x, y + i);
+}
+
+void fillrec(uint x, uint y, uint w, uint h)
+{
+	uint i, j;
+
+	for(j = 0; j < h; j++) {
+		for(i = 0; i < w; i++) {
+			point(x + i, y + j);
+		}
+	}
+}
+
+/* One data point of a graph, a scaled pixel wide, from y0 to y1 counted
+   up from the bottom edge. Whatever does not fit gets cut at the top. */
+
+void column(uint x, uint y0, uint y1)
+{
+	uint h = pix_height;
+
+	if(y1 > h) y1 = h;
+	if(y0 >= y1) return;
+
+	fillrec(x, h - y1, scale, y1 - y0);
+}
+
+static uint binlog(uint64_t v)
+{
+	uint ret = 0;
+
+	while(v) {
+		ret++;
+		v = v >> 1;
+	}
+
+	return ret;
+}
+
+uint log_scale(uint64_t total)
+{
+	if(!total)
+		return 0;
+
+	uint log = binlog(total);
+
+	if(log < 8)
+		return 1;
+
+	uint max = pix_height - 1;
+	uint bar = log - 7;
+
+	if(bar >= max)
+		return max;
+
+	return bar;
+}
+
+uint calc_txbar(uint64_t rx, uint64_t tx, uint bar)
+{
+	uint64_t total = rx + tx;
+
+	if(!total) return 0;
+
+	uint txbar = (bar*tx)/total;
+
+	if(bar == 1)
+		return rx > tx ? 0 : 1;
+
+	if(txbar > bar)
+		txbar = bar;
+
+	return txbar;
+}
+
 int load_file(char* name)
 {
 	int fd, ret;
 
+	iostats.syscalls += 3;
+
 	if((fd = open(name, O_RDONLY)) < 0)
 		return fd;
 	if((ret = read(fd, databuf, sizeof(databuf))) < 0)
 		return ret;
 
 	datalen = ret;
+	iostats.bytes += ret;
+
+	TRACE2(load_file, name, ret);
 
 	if((ret = close(fd)) < 0)
 		err(-1, "close");
@@ -80,15 +293,214 @@ int load_file(char* name)
 	return ret;
 }
 
+/* For files that may not fit into databuf. The buffer is kept between
+   calls and only grows, so after the first few reads it stays at the
+   size of the file and no more allocations happen. The contents are
+   always 0-terminated. */
+
+static int grow_buffer(struct buffer* bf)
+{
+	uint size = bf->size ? 2*bf->size : 4096;
+	char* data;
+
+	if(!(data = realloc(bf->data, size)))
+		return -1;
+
+	bf->data = data;
+	bf->size = size;
+
+	return 0;
+}
+
+int load_buffer(char* name, struct buffer* bf)
+{
+	uint len = 0;
+	int fd, ret;
+
+	iostats.syscalls += 2;
+
+	if((fd = open(name, O_RDONLY)) < 0)
+		return fd;
+
+	while(1) {
+		if(len + 1 >= bf->size && grow_buffer(bf) < 0)
+			break;
+
+		iostats.syscalls++;
+
+		if((ret = read(fd, bf->data + len, bf->size - len - 1)) <= 0)
+			break;
+
+		len += ret;
+	}
+
+	iostats.bytes += len;
+
+	TRACE2(load_file, name, len);
+
+	if((ret = close(fd)) < 0)
+		err(-1, "close");
+
+	if(!bf->data)
+		return -1;
+
+	bf->data[len] = '\0';
+	bf->len = len;
+
+	return 0;
+}
+
+/* Line by line reading for files too large to be loaded whole.
+   The fd is kept open and rewound on each pass, the buffer only holds
+   a chunk of the file at a time and grows only if a single line does
+   not fit into it. Lines are returned 0-terminated, in place.
+   Streams must be initialized with fd = -1. */
+
+int open_stream(struct stream* st, char* name)
+{
+	int fd;
+
+	if(st->fd >= 0)
+		return 0;
+	if((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+		return fd;
+
+	st->fd = fd;
+
+	return 0;
+}
+
+int rewind_stream(struct stream* st)
+{
+	st->ptr = 0;
+	st->end = 0;
+	st->eof = 0;
+
+	iostats.syscalls++;
+
+	return lseek(st->fd, 0, SEEK_SET);
+}
+
+static int fill_stream(struct stream* st)
+{
+	uint left = st->end - st->ptr;
+	int rd;
+
+	memmove(st->buf, st->buf + st->ptr, left);
+
+	st->ptr = 0;
+	st->end = left;
+
+	if(left + 1 >= st->size) {
+		uint size = st->size ? 2*st->size : 16384;
+		char* buf;
+
+		if(!(buf = realloc(st->buf, size)))
+			return -1;
+
+		st->buf = buf;
+		st->size = size;
+	}
+
+	iostats.syscalls++;
+
+	if((rd = read(st->fd, st->buf + left, st->size - left - 1)) <= 0)
+		st->eof = 1;
+	else {
+		st->end += rd;
+		iostats.bytes += rd;
+	}
+
+	return 0;
+}
+
+char* next_line(struct stream* st)
+{
+	char *p, *q;
+
+	while(1) {
+		p = st->buf + st->ptr;
+
+		if((q = skip_to_eol(p, st->buf + st->end)))
+			break;
+
+		if(!st->eof && fill_stream(st) >= 0)
+			continue;
+
+		if(st->ptr >= st->end)
+			return NULL;
+
+		q = st->buf + st->end; /* last line without newline */
+		break;
+	}
+
+	*q = '\0';
+
+	st->ptr = q - st->buf + 1;
+
+	if(st->ptr > st->end)
+		st->ptr = st->end;
+
+	return p;
+}
+
+/* Minimal formatting for building file names, no stdio here.
+   Both return the end of the output, never going past e. */
+
+char* fmtstr(char* p, char* e, char* s)
+{
+	while(p < e && *s)
+		*p++ = *s++;
+
+	return p;
+}
+
+/* Same as fmtstr but for a single path component, slashes would make
+   a path out of it. DISPLAY may have them. */
+
+char* fmtname(char* p, char* e, char* s)
+{
+	while(p < e && *s) {
+		*p++ = (*s == '/' ? '_' : *s);
+		s++;
+	}
+
+	return p;
+}
+
+char* fmtint(char* p, char* e, uint v)
+{
+	char buf[16];
+	char* q = buf + sizeof(buf);
+
+	do {
+		*--q = '0' + (v % 10);
+		v /= 10;
+	} while(v);
+
+	while(p < e && q < buf + sizeof(buf))
+		*p++ = *q++;
+
+	return p;
+}
+
+/* Stops at a newline or \0, whichever comes first. Two memchr passes,
+   the second one only up to the newline, are still much faster than
+   a byte loop checking both. */
+
 char* skip_to_eol(char* p, char* e)
 {
-	while(p < e)
-		if(!*p || *p == '\n')
-			return p;
-		else
-			p++;
+	char *q, *z;
+
+	if(p >= e)
+		return NULL;
+
+	if((q = memchr(p, '\n', e - p)))
+		e = q;
+	if((z = memchr(p, '\0', e - p)))
+		return z;
 
-	return NULL;
+	return q;
 }
 
 char* parse_int(char* p, uint* v)
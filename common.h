@@ -1,24 +1,157 @@
 #include <stdint.h>
 
+#include "xpstat.h"
+
 typedef unsigned int uint;
 typedef unsigned char byte;
 
 extern uint pix_width;
 extern uint pix_wused;
 extern uint pix_height;
-extern uint* image;
+extern uint scale;
+extern byte* image;
+extern uint pix_bytes;
 extern uint dtms;
 
 extern char databuf[2048];
 extern uint datalen;
 
+struct buffer {
+	char* data;
+	uint size;
+	uint len;
+};
+
+struct stream {
+	int fd;
+	char* buf;
+	uint size;
+	uint ptr;
+	uint end;
+	uint eof;
+};
+
+struct readreq {
+	int fd;
+	int ret; /* bytes read or -errno */
+	char* buf;
+	uint size;
+};
+
+/* Timing probes and io counters, see stats.c */
+
+#define NBUCKETS 16
+
+struct probe {
+	char* name;
+	char* what;
+	struct probe* next;
+	uint linked;
+	uint64_t count;
+	uint64_t total; /* ns */
+	uint64_t max;
+	uint hist[NBUCKETS];
+};
+
+struct iostats {
+	uint64_t syscalls;
+	uint64_t bytes;
+};
+
+extern struct iostats iostats;
+
+struct tickrec { /* see recorder.c */
+	uint64_t seq;
+	uint64_t start; /* ns, monotonic */
+	uint64_t parsed;
+	uint64_t rendered;
+	uint64_t flushed;
+	uint64_t bytes;
+	uint dtms;
+	uint xevents;
+	uint syscalls;
+};
+
+enum { /* history series, see history.c */
+	HS_CPUAVG,
+	HS_CPUMAX,
+	HS_NETRX,
+	HS_NETTX,
+	HS_DISKRD,
+	HS_DISKWR,
+	HS_MEMUSED,
+	NSERIES
+};
+
+struct bitmap { /* xbm layout */
+	byte* data;
+	int w;
+	int h;
+};
+
+struct tile { /* see tiles.c */
+	uint64_t key;
+	uint valid;
+	uint x, w, h;
+	uint size;
+	byte* data;
+};
+
+struct histval {
+	uint64_t min;
+	uint64_t max;
+	uint64_t avg;
+};
+
+/* Values parsed from files that more than one widget needs. Each file
+   is read once per tick, by whoever owns it, and the rest only look here.
+   Owners must come first in update_stats(). */
+
+struct statsample { /* /proc/stat, owned by cpuload */
+	uint64_t ctxt;
+	uint64_t intr;
+	uint running;
+	uint blocked;
+	uint valid;
+};
+
+struct sample {
+	struct statsample stat;
+};
+
+extern struct sample sample;
+extern struct xpstat xps;
+
 void advance(uint width);
 void moveto(uint x, uint y);
 void setcolor(uint c);
+void set_pixfmt(uint rmask, uint gmask, uint bmask, uint bpp);
 void point(uint x, uint y);
 void bitmap(byte* data, uint w, uint h);
+void scale_bitmaps(struct bitmap* bm, uint n);
+void hline(uint x, uint y, uint dx);
+void vline(uint x, uint y, uint dy);
+void fillrec(uint x, uint y, uint w, uint h);
+void column(uint x, uint y0, uint y1);
+
+uint small_width(char* str);
+uint small_height(void);
+void small_string(char* str);
+
+void add_source(int fd, uint events, void (*call)(void* data, uint events),
+                void* data);
+void poll_sources(void);
 
 int load_file(char* name);
+int load_buffer(char* name, struct buffer* bf);
+int open_stream(struct stream* st, char* name);
+int rewind_stream(struct stream* st);
+char* next_line(struct stream* st);
+void queue_read(struct readreq* rq, int fd, char* buf, uint size);
+void run_batch(void);
+char* fmtstr(char* p, char* e, char* s);
+char* fmtname(char* p, char* e, char* s);
+char* fmtint(char* p, char* e, uint v);
 char* skip_to_eol(char* p, char* e);
 char* parse_int(char* p, uint* v);
 char* parse_add(char* p, uint64_t* v);
@@ -26,9 +159,68 @@ char* skip_space(char* p);
 char* skip_word(char* p);
 char* skip_field(char* p);
 
+uint64_t stamp(void);
+void account(struct probe* pr, uint64_t t0);
+void init_stats(void);
+
+struct tickrec* begin_tick(void);
+void close_tick(uint xevents);
+void dump_recorder(void);
+
+void init_export(void);
+void publish_export(void);
+
+int blit_tile(struct tile* tl, uint64_t key);
+void save_tile(struct tile* tl, uint64_t key, uint x0);
+
+void init_history(void);
+void update_history(void);
+int get_history(uint tier, uint series, uint back, struct histval* hv);
+
+uint log_scale(uint64_t total);
+uint calc_txbar(uint64_t rx, uint64_t tx, uint bar);
+
+void init_digits(void);
+void init_clock(void);
 void init_mailbox(void);
+void init_pressure(void);
+void init_proctop(void);
+void init_cgroups(void);
+void init_thermal(void);
+
+void queue_cgroups(void);
+void queue_thermal(void);
+
+void update_battery(void);
+void update_mailbox(void);
+void update_cpuload(void);
+void update_netload(void);
+void update_nethealth(void);
+void update_pressure(void);
+void update_memory(void);
+void update_diskload(void);
+void update_sched(void);
+void update_irqload(void);
+void update_proctop(void);
+void update_cgroups(void);
+void update_thermal(void);
+
+uint64_t key_clock(void);
+uint64_t key_battery(void);
+uint64_t key_mailbox(void);
+
 void put_clock(void);
+void put_seconds(void);
 void put_battery(void);
 void put_cpuload(void);
 void put_netload(void);
+void put_nethealth(void);
 void put_mailbox(void);
+void put_pressure(void);
+void put_memory(void);
+void put_diskload(void);
+void put_sched(void);
+void put_irqload(void);
+void put_proctop(void);
+void put_cgroups(void);
+void put_thermal(void);
@@ -4,6 +4,9 @@
 
 #define MAXCPU 16
 #define GRAPHW 60
+#define GRAPHTIER 0
+
+#define S scale
 
 static struct cpustat {
 	uint64_t idle;
@@ -16,13 +19,9 @@ static struct cpudata {
 	uint load;
 } cpustats[MAXCPU];
 
-static struct cpupt {
-	byte max;
-	byte avg;
-} graph[GRAPHW];
-
 static uint ncpus;
-static uint graphptr;
+
+static struct buffer statbuf;
 
 static void update_cpu_deltas(uint idx)
 {
@@ -40,6 +39,8 @@ static void update_cpu_deltas(uint idx)
 		cd->load = 0;
 	else
 		cd->load = 1000*busy/total;
+
+	xps.cpuload[idx] = cd->load;
 }
 
 static void parse_stat_line(char* p)
@@ -52,6 +53,8 @@ static void parse_stat_line(char* p)
 		return;
 	if(cpuidx >= ncpus)
 		ncpus = cpuidx;
+	if(cpuidx >= xps.ncpus)
+		xps.ncpus = cpuidx + 1;
 
 	cpustat.busy = 0;
 	cpustat.idle = 0;
@@ -76,43 +79,43 @@ static uint graph_scale(uint v)
 	return v * (pix_height + 1) / 1000;
 }
 
-static void add_graph_line(void)
-{
-	uint max = 0;
-	uint min = 1001;
-	uint sum = 0;
-
-	if(!ncpus) return;
-
-	for(uint i = 0; i < ncpus; i++) {
-		struct cpudata* cd = &cpustats[i];
+/* The cpu lines come first, the rest of /proc/stat (ctxt, procs_running
+   and so on) goes into the shared sample for other widgets to use.
+   Those lines are only looked at if they are in the buffer anyway. */
 
-		uint load = cd->load;
+static char* prefix(char* p, char* pre, uint len)
+{
+	if(strncmp(p, pre, len))
+		return NULL;
 
-		if(load > max)
-			max = load;
-		if(load < min)
-			min = load;
+	return skip_space(p + len);
+}
 
-		sum += load;
-	} if(min > 1000) {
-		min = 0;
+static void parse_misc_line(char* p)
+{
+	struct statsample* ss = &sample.stat;
+	char* q;
+
+	if((q = prefix(p, "ctxt", 4))) {
+		ss->ctxt = 0;
+		parse_add(q, &ss->ctxt);
+	} else if((q = prefix(p, "intr", 4))) {
+		ss->intr = 0;
+		parse_add(q, &ss->intr);
+	} else if((q = prefix(p, "procs_running", 13))) {
+		parse_int(q, &ss->running);
+	} else if((q = prefix(p, "procs_blocked", 13))) {
+		parse_int(q, &ss->blocked);
+		ss->valid = 1;
 	}
-
-	uint avg = sum / ncpus;
-
-	struct cpupt* pt = &graph[graphptr];
-
-	pt->max = graph_scale(max);
-	pt->avg = graph_scale(avg);
-
-	graphptr = (graphptr + 1) % GRAPHW;
 }
 
 static void parse_proc_stat(void)
 {
-	char* p = databuf;
-	char* e = p + datalen;
+	char* p = statbuf.data;
+	char* e = p + statbuf.len;
+
+	sample.stat.valid = 0;
 
 	while(p < e) {
 		char* q = skip_to_eol(p, e);
@@ -121,52 +124,58 @@ static void parse_proc_stat(void)
 
 		*q = '\0';
 
-		if(strncmp(p, "cpu", 3))
-			break;
+		if(!strncmp(p, "cpu", 3))
+			parse_stat_line(p + 3);
+		else
+			parse_misc_line(p);
 
-		parse_stat_line(p + 3);
+		if(sample.stat.valid)
+			break;
 
 		p = q + 1;
 	}
-
-	add_graph_line();
 }
 
+/* The graph is drawn from history.c, any tier would do.
+   Tier 0 is the per-tick one, and survives panel restarts. */
+
 static void redraw_graph(void)
 {
+	struct histval avg, max;
 	uint i, w = GRAPHW;
-	uint h = pix_height;
 
 	for(i = 0; i < w; i++) {
-		uint k = (graphptr + i + 1) % GRAPHW;
-		struct cpupt* pt = &graph[k];
+		uint back = w - i - 1;
 
-		uint max = pt->max;
-		uint avg = pt->avg;
+		if(get_history(GRAPHTIER, HS_CPUAVG, back, &avg) < 0)
+			continue;
+		if(get_history(GRAPHTIER, HS_CPUMAX, back, &max) < 0)
+			continue;
 
-		uint y = 0;
-		uint x = 1 + i;
+		uint ya = graph_scale(avg.avg);
+		uint ym = graph_scale(max.max);
 
-		setcolor(0x007BAC);
+		uint x = S*(1 + i);
 
-		while(y < avg)
-			point(x, h - y++ - 1);
+		setcolor(0x007BAC);
+		column(x, 0, ya);
 
 		setcolor(0x555555);
-
-		while(y < max)
-			point(x, h - y++ - 1);
+		column(x, ya, ym);
 	}
 
-	advance(w + 2);
+	advance(S*(w + 2));
 }
 
-void put_cpuload(void)
+void update_cpuload(void)
 {
-	if(load_file("/proc/stat") < 0)
+	if(load_buffer("/proc/stat", &statbuf) < 0)
 		return;
 
 	parse_proc_stat();
+}
 
+void put_cpuload(void)
+{
 	redraw_graph();
 }
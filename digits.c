@@ -0,0 +1,81 @@
+#include "common.h"
+
+/* Small digits (and a colon) for widgets that need to show numbers
+   within the panel height, like battery time estimate. Anything that
+   is not a digit gets drawn as a colon. */
+
+#include "xbm/s0.xbm"
+#include "xbm/s1.xbm"
+#include "xbm/s2.xbm"
+#include "xbm/s3.xbm"
+#include "xbm/s4.xbm"
+#include "xbm/s5.xbm"
+#include "xbm/s6.xbm"
+#include "xbm/s7.xbm"
+#include "xbm/s8.xbm"
+#include "xbm/s9.xbm"
+#include "xbm/sc.xbm"
+
+#define XBM(name) { name##_bits, name##_width, name##_height }
+
+static struct bitmap bitmaps[] = {
+	XBM(s0),
+	XBM(s1),
+	XBM(s2),
+	XBM(s3),
+	XBM(s4),
+	XBM(s5),
+	XBM(s6),
+	XBM(s7),
+	XBM(s8),
+	XBM(s9),
+	XBM(sc),
+};
+
+#define NBITMAPS (sizeof(bitmaps)/sizeof(*bitmaps))
+
+void init_digits(void)
+{
+	scale_bitmaps(bitmaps, NBITMAPS);
+}
+
+static uint glyph(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	else
+		return 10;
+}
+
+static void draw_xbm(uint idx)
+{
+	struct bitmap* bm = &bitmaps[idx];
+
+	bitmap(bm->data, bm->w, bm->h);
+}
+
+uint small_width(char* str)
+{
+	char* p = str;
+	uint w = 0;
+	char c;
+
+	while((c = *p++))
+		w += bitmaps[glyph(c)].w;
+
+	return w;
+}
+
+uint small_height(void)
+{
+	return bitmaps[0].h;
+}
+
+void small_string(char* str)
+{
+	char* p = str;
+	char c;
+
+	while((c = *p++))
+		draw_xbm(glyph(c));
+}
@@ -0,0 +1,275 @@
+#include <unistd.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Disk throughput graph from /proc/diskstats, read/write bars like
+   in netload plus the busiest device utilization (io_ticks) as a line.
+
+   With lots of loop devices and NVMe namespaces the file may easily be
+   hundreds of lines long, so devices are kept in a hash keyed on their
+   major:minor. Whether a device should be counted at all (partitions,
+   loop, dm etc are not) is decided once, on first sight; after that,
+   skipped lines cost a hash lookup and nothing else. */
+
+#define GRAPHW 60
+#define NSLOTS 1024 /* power of 2 */
+
+#define S scale
+
+struct diskdev {
+	uint key;
+	uint used;
+	uint skip;
+	uint seen;
+	uint64_t rd;    /* sectors */
+	uint64_t wr;
+	uint64_t ticks; /* ms */
+};
+
+static struct diskdev devs[NSLOTS];
+
+static struct diskpt {
+	byte rd;
+	byte wr;
+	byte util;
+} graph[GRAPHW];
+
+static struct buffer diskbuf;
+static uint graphptr;
+static uint generation = 1;
+
+static struct disksum {
+	uint64_t rd;  /* bytes */
+	uint64_t wr;
+	uint util;    /* per mille, busiest device */
+	uint count;
+} sum;
+
+static const char* skipped[] = {
+	"loop",
+	"ram",
+	"zram",
+	"dm-",
+	"md"
+};
+
+static uint hash_key(uint key)
+{
+	return (key * 2654435761U) >> 22; /* top 10 bits */
+}
+
+static struct diskdev* find_device(uint key)
+{
+	uint i = hash_key(key);
+	uint n;
+
+	for(n = 0; n < NSLOTS; n++) {
+		struct diskdev* dd = &devs[i];
+
+		if(!dd->used)
+			return dd;
+		if(dd->key == key)
+			return dd;
+
+		i = (i + 1) % NSLOTS;
+	}
+
+	return NULL;
+}
+
+static int is_partition(uint major, uint minor)
+{
+	char path[64];
+	char* p = path;
+	char* e = path + sizeof(path) - 1;
+
+	p = fmtstr(p, e, "/sys/dev/block/");
+	p = fmtint(p, e, major);
+	p = fmtstr(p, e, ":");
+	p = fmtint(p, e, minor);
+	p = fmtstr(p, e, "/partition");
+	*p = '\0';
+
+	return !access(path, F_OK);
+}
+
+static int skip_device(char* name, uint major, uint minor)
+{
+	uint i, n = sizeof(skipped)/sizeof(*skipped);
+
+	for(i = 0; i < n; i++)
+		if(!strncmp(name, skipped[i], strlen(skipped[i])))
+			return 1;
+
+	return is_partition(major, minor);
+}
+
+static void init_device(struct diskdev* dd, uint key, char* p)
+{
+	uint major = key >> 20;
+	uint minor = key & 0xFFFFF;
+
+	dd->used = 1;
+	dd->key = key;
+	dd->skip = skip_device(p, major, minor);
+}
+
+static void account_device(struct diskdev* dd, uint64_t rd, uint64_t wr,
+                           uint64_t ticks)
+{
+	uint first = (dd->seen + 1 != generation); /* new or re-added */
+
+	uint64_t drd = rd - dd->rd;
+	uint64_t dwr = wr - dd->wr;
+	uint64_t dtk = ticks - dd->ticks;
+
+	dd->rd = rd;
+	dd->wr = wr;
+	dd->ticks = ticks;
+	dd->seen = generation;
+
+	if(first)
+		return;
+
+	sum.rd += 512*drd;
+	sum.wr += 512*dwr;
+	sum.count++;
+
+	if(!dtms)
+		return;
+
+	uint util = 1000*dtk/dtms;
+
+	if(util > 1000)
+		util = 1000;
+	if(util > sum.util)
+		sum.util = util;
+}
+
+/*   8       0 sda 1 2 3 4 5 6 7 8 9 10 ...
+
+   Fields after the name: 3 is sectors read, 7 sectors written,
+   10 is io_ticks. */
+
+static void parse_disk_line(char* p)
+{
+	uint major, minor, key;
+	uint64_t val[10];
+	struct diskdev* dd;
+	uint i;
+
+	p = skip_space(p);
+
+	if(!(p = parse_int(p, &major)))
+		return;
+	if(!(p = parse_int(p, &minor)))
+		return;
+
+	key = (major << 20) | (minor & 0xFFFFF);
+
+	if(!(dd = find_device(key)))
+		return;
+	if(!dd->used)
+		init_device(dd, key, p);
+	if(dd->skip)
+		return;
+
+	p = skip_field(p);
+
+	for(i = 0; i < 10; i++) {
+		val[i] = 0;
+
+		if(!(p = parse_add(p, &val[i])))
+			return;
+	}
+
+	account_device(dd, val[2], val[6], val[9]);
+}
+
+static void parse_diskstats(void)
+{
+	char* p = diskbuf.data;
+	char* e = p + diskbuf.len;
+
+	while(p < e) {
+		char* q = skip_to_eol(p, e);
+
+		if(!q) break;
+
+		*q = '\0';
+
+		parse_disk_line(p);
+
+		p = q + 1;
+	}
+}
+
+static uint util_scale(uint v)
+{
+	return v * (pix_height - 1) / 1000;
+}
+
+static void add_graph_point(void)
+{
+	struct diskpt* pt = &graph[graphptr];
+
+	uint bar = log_scale(sum.rd + sum.wr);
+	uint gwr = calc_txbar(sum.rd, sum.wr, bar);
+
+	pt->wr = gwr;
+	pt->rd = bar - gwr;
+	pt->util = sum.count ? util_scale(sum.util) : 0;
+
+	xps.disk_rd = dtms ? sum.rd*1000/dtms : 0;
+	xps.disk_wr = dtms ? sum.wr*1000/dtms : 0;
+	xps.disk_util = sum.util;
+
+	graphptr = (graphptr + 1) % GRAPHW;
+}
+
+void update_diskload(void)
+{
+	if(load_buffer("/proc/diskstats", &diskbuf) < 0)
+		return;
+
+	memset(&sum, 0, sizeof(sum));
+
+	generation++;
+
+	parse_diskstats();
+
+	add_graph_point();
+}
+
+void put_diskload(void)
+{
+	uint i, w = GRAPHW;
+
+	if(!diskbuf.len)
+		return;
+
+	for(i = 0; i < w; i++) {
+		uint k = (graphptr + i) % GRAPHW;
+		struct diskpt* pt = &graph[k];
+
+		uint rd = pt->rd;
+		uint wr = pt->wr;
+
+		uint x = S*(1 + i);
+
+		setcolor(0x3BB489);
+		column(x, 0, wr);
+
+		setcolor(0x1598A9);
+		column(x, wr, wr + rd);
+
+		if(!pt->util)
+			continue;
+
+		setcolor(0xAAAAAA);
+		column(x, pt->util, pt->util + 1);
+	}
+
+	advance(S*(w + 2));
+}
@@ -0,0 +1,142 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <err.h>
+
+#include "common.h"
+
+/* Widgets fill xps during the tick, and publish_export() copies it
+   into the shared segment at the end of it, so the window during which
+   readers may see an odd seq is just the memcpy and not the whole tick.
+   See xpstat.h for the reader side of things.
+
+   Without the segment, widgets still write into xps and nothing else
+   happens, they never have to check whether export is enabled.
+
+   /dev/shm is shared by all users, so the file is only used if it is
+   a regular file that belongs to us with mode 0600. Anything else there
+   means someone else got to the name first, and export stays off.
+
+   The name is per display, and the file is locked for as long as the
+   panel runs, since the seqlock only works with a single writer.
+   A panel that cannot get the lock does not export anything.
+   On exit, the magic gets cleared and the file removed so that readers
+   do not keep showing the last values of a panel that is gone. */
+
+struct xpstat xps;
+
+static struct xpstat* shared;
+static char shmpath[128];
+static int shmfd = -1;
+
+static void shm_path(char* buf, uint size)
+{
+	char* p = buf;
+	char* e = buf + size - 1;
+	char* dpy;
+
+	if(!(dpy = getenv("DISPLAY")))
+		dpy = "";
+
+	p = fmtstr(p, e, "/dev/shm/xpanel.");
+	p = fmtint(p, e, getuid());
+	p = fmtstr(p, e, ".");
+	p = fmtname(p, e, dpy);
+	*p = '\0';
+}
+
+static int check_owner(int fd)
+{
+	struct stat st;
+
+	if(fstat(fd, &st) < 0)
+		return -1;
+	if(!S_ISREG(st.st_mode))
+		return -1;
+	if(st.st_uid != getuid())
+		return -1;
+	if((st.st_mode & 07777) != 0600)
+		return -1;
+
+	return 0;
+}
+
+static void close_export(void)
+{
+	__atomic_store_n(&shared->magic, 0, __ATOMIC_RELEASE);
+
+	unlink(shmpath);
+}
+
+void init_export(void)
+{
+	int flags = O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC;
+	void* ptr;
+	int fd;
+
+	shm_path(shmpath, sizeof(shmpath));
+
+	if((fd = open(shmpath, flags, 0600)) < 0)
+		return;
+
+	if(check_owner(fd) < 0) {
+		warnx("%s: not a private file, export disabled", shmpath);
+		goto close;
+	}
+	if(flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		warnx("%s: in use, export disabled", shmpath);
+		goto close;
+	}
+
+	if(ftruncate(fd, sizeof(*shared)) < 0)
+		goto close;
+
+	ptr = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+	           MAP_SHARED, fd, 0);
+
+	if(ptr == MAP_FAILED)
+		goto close;
+
+	shared = ptr;
+
+	memset(shared, 0, sizeof(*shared));
+
+	shared->version = XPSTAT_VERSION;
+	shared->size = sizeof(*shared);
+
+	__atomic_store_n(&shared->magic, XPSTAT_MAGIC, __ATOMIC_RELEASE);
+
+	shmfd = fd; /* keeps the lock */
+
+	atexit(close_export);
+
+	return;
+close:
+	close(fd);
+}
+
+void publish_export(void)
+{
+	uint off = offsetof(struct xpstat, time);
+	uint seq;
+
+	if(!shared)
+		return;
+
+	xps.time = stamp();
+	xps.dtms = dtms;
+
+	seq = shared->seq + 1;
+
+	__atomic_store_n(&shared->seq, seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy((char*)shared + off, (char*)&xps + off, sizeof(xps) - off);
+
+	__atomic_store_n(&shared->seq, seq + 1, __ATOMIC_RELEASE);
+}
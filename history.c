@@ -0,0 +1,426 @@
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+
+/* Long-term history, RRD style. A few series taken from the export
+   struct at the end of each tick, kept in fixed rings at three
+   resolutions: every tick (0.5s), 10s and 5min. The coarser tiers
+   store min, max and average of the samples that went into each point.
+
+   Everything including the partial consolidation sums lives in a file
+   that is simply mmap'ed, so restarting the panel restores all of it
+   without reading or parsing anything. Time spent not running shows
+   up as empty points, up to the ring size of each tier.
+
+   Values are stored as 16-bit minifloats, 11 bits of mantissa and
+   5 bits of exponent. Exact up to 2047 which covers per mille loads,
+   within 0.1% for rates. A week of 5min points, six hours of 10s points
+   and a minute of ticks for all series come out under 200KB.
+
+   The file is per host and display, since home directories are often
+   shared between machines, and one machine may run several panels.
+   It is also locked, and a panel that cannot get the lock (another one
+   running with the same name, or a filesystem without locks) keeps its
+   history in memory instead of writing over someone else's. */
+
+#define HISTMAGIC 0x54534858 /* "XHST" */
+#define HISTVERSION 1
+
+#define NTIERS 3
+
+struct histpt {
+	uint16_t min;
+	uint16_t max;
+	uint16_t avg;
+};
+
+struct histacc {
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t count;
+	uint32_t pad;
+};
+
+struct histtier {
+	uint32_t size;  /* points in the ring */
+	uint32_t step;  /* ticks per point */
+	uint32_t head;  /* next point to write */
+	uint32_t count; /* points written, up to size */
+	struct histacc acc[NSERIES];
+};
+
+struct histhdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nseries;
+	uint32_t ntiers;
+	uint64_t last; /* CLOCK_REALTIME ms of the last tick */
+	struct histtier tiers[NTIERS];
+};
+
+static const struct tierdef {
+	uint size;
+	uint step;
+} tierdefs[NTIERS] = {
+	{ 120,    1 }, /* 1 minute at 0.5s */
+	{ 2160,  20 }, /* 6 hours at 10s */
+	{ 2016, 600 }  /* 1 week at 5min */
+};
+
+#define TICKMS 500
+
+static int histfd = -1;
+static struct histhdr* hdr;
+static struct histpt* rings[NTIERS];
+static size_t mapsize;
+
+static uint16_t encode(uint64_t v)
+{
+	uint e = 0;
+
+	while(v >= 2048 && e < 31) {
+		v >>= 1;
+		e++;
+	}
+
+	if(v >= 2048)
+		v = 2047;
+
+	return (e << 11) | v;
+}
+
+static uint64_t decode(uint16_t x)
+{
+	return (uint64_t)(x & 2047) << (x >> 11);
+}
+
+static size_t file_size(void)
+{
+	size_t size = sizeof(struct histhdr);
+
+	for(uint i = 0; i < NTIERS; i++)
+		size += tierdefs[i].size * NSERIES * sizeof(struct histpt);
+
+	return size;
+}
+
+static uint64_t wallclock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ts.tv_sec*1000ULL + ts.tv_nsec/1000000;
+}
+
+/* No /tmp fallback, a predictable name there could be pointed
+   at some other file of ours. */
+
+static char* hist_path(char* buf, uint size)
+{
+	char* p = buf;
+	char* e = buf + size - 1;
+	char host[64];
+	char* dir;
+	char* dpy;
+
+	if((dir = getenv("XDG_CACHE_HOME")) && *dir == '/') {
+		p = fmtstr(p, e, dir);
+	} else if((dir = getenv("HOME")) && *dir == '/') {
+		p = fmtstr(p, e, dir);
+		p = fmtstr(p, e, "/.cache");
+	} else {
+		return NULL;
+	}
+
+	if(gethostname(host, sizeof(host)) < 0)
+		return NULL;
+
+	host[sizeof(host)-1] = '\0';
+
+	if(!(dpy = getenv("DISPLAY")))
+		dpy = "";
+
+	p = fmtstr(p, e, "/xpanel.");
+	p = fmtname(p, e, host);
+	p = fmtstr(p, e, ".");
+	p = fmtname(p, e, dpy);
+	p = fmtstr(p, e, ".hist");
+
+	if(p >= e)
+		return NULL;
+
+	*p = '\0';
+
+	return buf;
+}
+
+/* The fd stays open to keep the lock. */
+
+static void* map_file(size_t size)
+{
+	char path[512];
+	void* ptr;
+	int fd;
+
+	if(!hist_path(path, sizeof(path)))
+		return NULL;
+
+	if((fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0)
+		return NULL;
+
+	if(flock(fd, LOCK_EX | LOCK_NB) < 0)
+		goto close;
+	if(ftruncate(fd, size) < 0)
+		goto close;
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if(ptr == MAP_FAILED)
+		goto close;
+
+	histfd = fd;
+
+	return ptr;
+close:
+	close(fd);
+
+	return NULL;
+}
+
+/* No file means history does not survive restarts, but the graphs
+   still get their data from here. */
+
+static void* map_memory(size_t size)
+{
+	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int valid_header(void)
+{
+	if(hdr->magic != HISTMAGIC)
+		return 0;
+	if(hdr->version != HISTVERSION)
+		return 0;
+	if(hdr->nseries != NSERIES || hdr->ntiers != NTIERS)
+		return 0;
+
+	for(uint i = 0; i < NTIERS; i++) {
+		struct histtier* ht = &hdr->tiers[i];
+
+		if(ht->size != tierdefs[i].size || ht->step != tierdefs[i].step)
+			return 0;
+		if(ht->head >= ht->size || ht->count > ht->size)
+			return 0;
+	}
+
+	return 1;
+}
+
+static void reset_header(void)
+{
+	memset(hdr, 0, mapsize);
+
+	hdr->version = HISTVERSION;
+	hdr->nseries = NSERIES;
+	hdr->ntiers = NTIERS;
+
+	for(uint i = 0; i < NTIERS; i++) {
+		hdr->tiers[i].size = tierdefs[i].size;
+		hdr->tiers[i].step = tierdefs[i].step;
+	}
+
+	hdr->magic = HISTMAGIC;
+}
+
+static void reset_acc(struct histtier* ht)
+{
+	memset(ht->acc, 0, sizeof(ht->acc));
+}
+
+static void push_point(uint tier, struct histpt* pts)
+{
+	struct histtier* ht = &hdr->tiers[tier];
+	struct histpt* dst = rings[tier] + ht->head*NSERIES;
+
+	memcpy(dst, pts, NSERIES*sizeof(*pts));
+
+	ht->head = (ht->head + 1) % ht->size;
+
+	if(ht->count < ht->size)
+		ht->count++;
+}
+
+static void push_empty(uint tier, uint64_t n)
+{
+	struct histpt pts[NSERIES];
+
+	memset(pts, 0, sizeof(pts));
+
+	if(n > hdr->tiers[tier].size)
+		n = hdr->tiers[tier].size;
+
+	while(n-- > 0)
+		push_point(tier, pts);
+}
+
+static void fill_gap(void)
+{
+	uint64_t now = wallclock();
+	uint64_t gap;
+
+	if(!hdr->last || now < hdr->last)
+		return;
+	if((gap = (now - hdr->last) / TICKMS) < 2)
+		return;
+
+	for(uint i = 0; i < NTIERS; i++) {
+		struct histtier* ht = &hdr->tiers[i];
+
+		push_empty(i, gap / ht->step);
+		reset_acc(ht);
+	}
+}
+
+void init_history(void)
+{
+	char* ptr;
+
+	mapsize = file_size();
+
+	if(!(ptr = map_file(mapsize)) && !(ptr = map_memory(mapsize)))
+		return;
+
+	hdr = (struct histhdr*)ptr;
+	ptr += sizeof(*hdr);
+
+	for(uint i = 0; i < NTIERS; i++) {
+		rings[i] = (struct histpt*)ptr;
+		ptr += tierdefs[i].size * NSERIES * sizeof(struct histpt);
+	}
+
+	if(!valid_header())
+		reset_header();
+	else
+		fill_gap();
+}
+
+static void take_sample(uint64_t* val)
+{
+	uint i, n = xps.ncpus;
+	uint sum = 0, max = 0;
+	uint64_t rx = 0, tx = 0;
+
+	if(n > XPSTAT_MAXCPU)
+		n = XPSTAT_MAXCPU;
+
+	for(i = 0; i < n; i++) {
+		uint load = xps.cpuload[i];
+
+		sum += load;
+
+		if(load > max)
+			max = load;
+	}
+
+	for(i = 0; i < XPSTAT_MAXNET; i++) {
+		rx += xps.net[i].rx;
+		tx += xps.net[i].tx;
+	}
+
+	val[HS_CPUAVG] = n ? sum / n : 0;
+	val[HS_CPUMAX] = max;
+	val[HS_NETRX] = rx;
+	val[HS_NETTX] = tx;
+	val[HS_DISKRD] = xps.disk_rd;
+	val[HS_DISKWR] = xps.disk_wr;
+	val[HS_MEMUSED] = xps.mem_total > xps.mem_avail ?
+	                  xps.mem_total - xps.mem_avail : 0;
+}
+
+static void accumulate(struct histacc* ha, uint64_t v)
+{
+	if(!ha->count || v < ha->min)
+		ha->min = v;
+	if(!ha->count || v > ha->max)
+		ha->max = v;
+
+	ha->sum += v;
+	ha->count++;
+}
+
+static void consolidate(uint tier, uint64_t* val)
+{
+	struct histtier* ht = &hdr->tiers[tier];
+	struct histpt pts[NSERIES];
+	uint i;
+
+	for(i = 0; i < NSERIES; i++)
+		accumulate(&ht->acc[i], val[i]);
+
+	if(ht->acc[0].count < ht->step)
+		return;
+
+	for(i = 0; i < NSERIES; i++) {
+		struct histacc* ha = &ht->acc[i];
+
+		pts[i].min = encode(ha->min);
+		pts[i].max = encode(ha->max);
+		pts[i].avg = encode(ha->sum / ha->count);
+	}
+
+	reset_acc(ht);
+
+	push_point(tier, pts);
+}
+
+void update_history(void)
+{
+	uint64_t val[NSERIES];
+
+	if(!hdr)
+		return;
+
+	take_sample(val);
+
+	for(uint i = 0; i < NTIERS; i++)
+		consolidate(i, val);
+
+	hdr->last = wallclock();
+}
+
+/* Point back steps before the latest one, 0 being the latest. */
+
+int get_history(uint tier, uint series, uint back, struct histval* hv)
+{
+	struct histtier* ht;
+	struct histpt* pt;
+	uint idx;
+
+	if(!hdr || tier >= NTIERS || series >= NSERIES)
+		return -1;
+
+	ht = &hdr->tiers[tier];
+
+	if(back >= ht->count)
+		return -1;
+
+	idx = (ht->head + ht->size - 1 - back) % ht->size;
+	pt = rings[tier] + idx*NSERIES + series;
+
+	hv->min = decode(pt->min);
+	hv->max = decode(pt->max);
+	hv->avg = decode(pt->avg);
+
+	return 0;
+}
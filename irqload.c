@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Interrupt distribution heatmap, top few IRQs by rate (rows) against
+   CPUs or groups of adjacent CPUs (columns).
+
+   On large machines /proc/interrupts gets hundreds of KB wide, so it is
+   read through a stream, one line at a time, never whole.
+
+   The layout is assumed to be mostly stable between ticks. The header
+   only gets tokenized when it changes (CPU hotplug), and the rows are kept
+   in the order they were seen last time, so finding the row for a line
+   is normally just a label compare against the next expected row.
+
+   Only numbered IRQs are counted. The arch lines (LOC, RES, TLB etc)
+   would dominate everything and are not what affinity setup is about. */
+
+#define MAXIRQ 512
+#define TOPN 4
+#define HEATW 64
+
+#define S scale
+
+struct irqrow {
+	char label[12];
+	uint* prev;
+	uint total;
+	byte heat[HEATW];
+};
+
+static struct stream irqst = { .fd = -1 };
+
+static struct irqrow rows[MAXIRQ];
+static uint nrows;
+
+static char* header;
+static uint hdrlen;
+static uint ncols;   /* online CPUs */
+static uint ngroups; /* heatmap columns */
+static uint grpsize; /* CPUs per column */
+
+static byte heat[TOPN][HEATW];
+static uint ntop;
+
+static uint count_columns(char* p)
+{
+	uint n = 0;
+
+	while(*(p = skip_space(p))) {
+		p = skip_word(p);
+		n++;
+	}
+
+	return n;
+}
+
+static void reset_rows(void)
+{
+	for(uint i = 0; i < nrows; i++) {
+		free(rows[i].prev);
+		rows[i].prev = NULL;
+	}
+
+	nrows = 0;
+}
+
+static void parse_header(char* p)
+{
+	uint len = strlen(p);
+
+	if(header && len == hdrlen && !memcmp(header, p, len))
+		return;
+
+	free(header);
+
+	if(!(header = strdup(p)))
+		hdrlen = 0;
+	else
+		hdrlen = len;
+
+	ncols = count_columns(p);
+	grpsize = (ncols + HEATW - 1) / HEATW;
+	ngroups = grpsize ? (ncols + grpsize - 1) / grpsize : 0;
+
+	reset_rows(); /* column sets differ, old counters are useless */
+}
+
+static void swap_rows(uint i, uint j)
+{
+	struct irqrow tmp = rows[i];
+
+	rows[i] = rows[j];
+	rows[j] = tmp;
+}
+
+/* The row for line number idx. If the layout has changed, whatever
+   matches gets moved into place so the next tick is back to fast path. */
+
+static struct irqrow* find_row(char* label, uint idx)
+{
+	uint i;
+
+	if(idx < nrows && !strcmp(rows[idx].label, label))
+		return &rows[idx];
+
+	for(i = 0; i < nrows; i++)
+		if(!strcmp(rows[i].label, label))
+			break;
+
+	if(i < nrows)
+		;
+	else if(nrows >= MAXIRQ)
+		return NULL;
+	else
+		memset(&rows[nrows++], 0, sizeof(*rows));
+
+	if(idx < nrows && i != idx)
+		swap_rows(i, idx);
+	else
+		idx = i;
+
+	return &rows[idx];
+}
+
+static uint heat_level(uint v)
+{
+	uint log = 0;
+
+	while(v) {
+		log++;
+		v >>= 1;
+	}
+
+	return log > 16 ? 8 : (log + 1) / 2;
+}
+
+/* This is where nearly all the time goes on large machines, one call per
+   IRQ per CPU, so it gets a tight inlined loop instead of parse_int(). */
+
+static inline char* next_count(char* p, uint* v)
+{
+	uint r = 0;
+	uint d;
+
+	while(*p == ' ')
+		p++;
+
+	while((d = (byte)*p - '0') < 10) {
+		r = r*10 + d;
+		p++;
+	}
+
+	*v = r;
+
+	return p;
+}
+
+static void parse_counts(struct irqrow* ir, char* p)
+{
+	uint i, g, cnt, sum = 0;
+	uint first = !ir->prev;
+
+	if(first && !(ir->prev = calloc(ncols, sizeof(uint))))
+		return;
+
+	ir->total = 0;
+
+	for(i = 0, g = 0; i < ncols; i++) {
+		p = next_count(p, &cnt);
+
+		uint delta = cnt - ir->prev[i];
+		ir->prev[i] = cnt;
+
+		sum += delta;
+		ir->total += delta;
+
+		if((i + 1) % grpsize && i + 1 < ncols)
+			continue;
+
+		ir->heat[g++] = heat_level(sum);
+		sum = 0;
+	}
+
+	if(first)
+		ir->total = 0;
+}
+
+static int parse_irq_line(char* p, uint idx)
+{
+	char *q, *label = skip_space(p);
+	struct irqrow* ir;
+
+	if(*label < '0' || *label > '9')
+		return 0;
+	if(!(q = strchr(label, ':')))
+		return 0;
+	if(q - label >= sizeof(ir->label))
+		return 0;
+
+	*q++ = '\0';
+
+	if(!(ir = find_row(label, idx)))
+		return 0;
+	if(!ir->label[0])
+		strcpy(ir->label, label);
+
+	parse_counts(ir, q);
+
+	return 1;
+}
+
+static void pick_top_rows(void)
+{
+	struct irqrow* top[TOPN];
+	uint i, j, n = 0;
+
+	for(i = 0; i < nrows; i++) {
+		struct irqrow* ir = &rows[i];
+
+		if(!ir->total)
+			continue;
+
+		for(j = n; j > 0 && top[j-1]->total < ir->total; j--)
+			if(j < TOPN)
+				top[j] = top[j-1];
+
+		if(j < TOPN)
+			top[j] = ir;
+		if(n < TOPN)
+			n++;
+	}
+
+	for(i = 0; i < n; i++)
+		memcpy(heat[i], top[i]->heat, sizeof(heat[i]));
+
+	ntop = n;
+}
+
+void update_irqload(void)
+{
+	char* p;
+	uint idx = 0;
+
+	if(open_stream(&irqst, "/proc/interrupts") < 0)
+		return;
+	if(rewind_stream(&irqst) < 0)
+		return;
+	if(!(p = next_line(&irqst)))
+		return;
+
+	parse_header(p);
+
+	for(uint i = 0; i < nrows; i++)
+		rows[i].total = 0;
+
+	while((p = next_line(&irqst)))
+		idx += parse_irq_line(p, idx);
+
+	pick_top_rows();
+}
+
+static const uint palette[9] = {
+	0x000000, 0x301008, 0x501808, 0x782008,
+	0xA02808, 0xC84008, 0xE06010, 0xF09020,
+	0xFFC040
+};
+
+void put_irqload(void)
+{
+	uint bh = pix_height / TOPN;
+	uint cw = S*(ngroups < 16 ? 16 / ngroups : 1);
+	uint i, j;
+
+	if(!ngroups)
+		return;
+
+	for(i = 0; i < ntop; i++) {
+		for(j = 0; j < ngroups; j++) {
+			uint lvl = heat[i][j];
+
+			if(!lvl) continue;
+
+			setcolor(palette[lvl]);
+			fillrec(S + j*cw, i*bh, cw, bh - 1);
+		}
+	}
+
+	advance(ngroups*cw + 2*S);
+}
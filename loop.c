@@ -0,0 +1,76 @@
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include "common.h"
+
+/* Main event loop. Anything that needs to wait on a fd registers itself
+   with add_source() from its init code, and gets its handler called
+   with the supplied data pointer whenever epoll reports the fd ready.
+
+   All sources are edge-triggered, so handlers must drain their fds
+   until EAGAIN (or otherwise make sure nothing is left pending) before
+   returning. In exchange, nothing is ever reported twice and dispatch
+   only touches the sources that are actually ready. */
+
+#define MAXSRC 32
+
+static struct source {
+	int fd;
+	void (*call)(void* data, uint events);
+	void* data;
+} sources[MAXSRC];
+
+static uint nsources;
+static int epfd = -1;
+
+static void open_epoll_fd(void)
+{
+	if((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		err(-1, "epoll_create");
+}
+
+void add_source(int fd, uint events, void (*call)(void* data, uint events),
+                void* data)
+{
+	struct source* src;
+	struct epoll_event ev;
+
+	if(epfd < 0)
+		open_epoll_fd();
+	if(nsources >= MAXSRC)
+		errx(-1, "too many event sources");
+
+	src = &sources[nsources++];
+	src->fd = fd;
+	src->call = call;
+	src->data = data;
+
+	ev.events = events | EPOLLET;
+	ev.data.ptr = src;
+
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		err(-1, "epoll_ctl");
+}
+
+void poll_sources(void)
+{
+	struct epoll_event evs[MAXSRC];
+	int i, n;
+
+	if(epfd < 0)
+		open_epoll_fd();
+
+	if((n = epoll_wait(epfd, evs, MAXSRC, -1)) < 0) {
+		if(errno == EINTR)
+			return;
+		err(-1, "epoll_wait");
+	}
+
+	for(i = 0; i < n; i++) {
+		struct source* src = evs[i].data.ptr;
+
+		src->call(src->data, evs[i].events);
+	}
+}
@@ -1,53 +1,440 @@
+#include <sys/inotify.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
 
 #include "common.h"
 
 #include "xbm/mo.xbm"
 #include "xbm/mn.xbm"
 
-static char* MAIL;
+/* Mailboxes are mostly looked at when inotify reports something happening
+   to them, there is no per-tick stat().
+
+   For mbox files, the watch is placed on the parent directory so that
+   the file being created, removed or replaced gets noticed as well.
+   Events for unrelated files in the same directory are filtered out
+   by name, and the mbox gets stat'ed once per relevant event.
+
+   Maildirs get a watch on their new/ subdirectory. The number of messages
+   there is kept incrementally from create/move/delete events, and the
+   directory is only scanned once on startup and on queue overflow.
+
+   Boxes without a watch (the directory is missing, got removed or moved
+   away, or inotify is not available at all) are polled instead, and the
+   watch gets re-armed as soon as it can be. All boxes also get re-checked
+   once a minute, since inotify never sees changes made by other clients
+   on network filesystems. For Maildirs that is just a stat() of new/,
+   which only gets scanned again if its mtime has changed. */
+
+#define POLLTICKS 10   /* 5s, boxes without a watch */
+#define RECHECK  120   /* 60s, all boxes */
+
+#define MAXBOX 8
+
+#define MBOX    1
+#define MAILDIR 2
+
+#define EMPTY 0
+#define OLD   1
+#define NEW   2
+
+static struct mailbox {
+	uint type;
+	int wd;
+	uint mask;
+	char* dir;    /* watched directory */
+	char* name;   /* mbox file name in dir */
+	uint count;   /* messages in Maildir new/ */
+	uint state;
+	struct timespec mtime; /* of new/ when it was last scanned */
+} boxes[MAXBOX];
+
+static uint nboxes;
+
+#define OLDICON 0
+#define NEWICON 1
+
+static struct bitmap icons[] = {
+	{ mo_bits, mo_width, mo_height },
+	{ mn_bits, mn_width, mn_height }
+};
+
+static int mail_fd = -1;
+static uint ticks;
+
+static void check_mbox(struct mailbox* mb)
+{
+	struct stat st;
+	char path[1024];
+	int len = strlen(mb->dir);
+
+	if(len + strlen(mb->name) + 2 > sizeof(path))
+		return;
+
+	memcpy(path, mb->dir, len);
+	path[len] = '/';
+	strcpy(path + len + 1, mb->name);
+
+	if(stat(path, &st) < 0 || !st.st_size)
+		mb->state = EMPTY;
+	else if(st.st_atime < st.st_mtime)
+		mb->state = NEW;
+	else
+		mb->state = OLD;
+}
+
+static void set_maildir_state(struct mailbox* mb)
+{
+	mb->state = mb->count ? NEW : EMPTY;
+}
+
+static void scan_maildir(struct mailbox* mb)
+{
+	DIR* dp;
+	struct dirent* de;
+	struct stat st;
+	uint count = 0;
+
+	if(!(dp = opendir(mb->dir))) {
+		memset(&mb->mtime, 0, sizeof(mb->mtime));
+		mb->count = 0;
+		set_maildir_state(mb);
+		return;
+	}
+
+	if(fstat(dirfd(dp), &st) >= 0)
+		mb->mtime = st.st_mtim;
+
+	while((de = readdir(dp)))
+		if(de->d_name[0] != '.')
+			count++;
+
+	closedir(dp);
+
+	mb->count = count;
+
+	set_maildir_state(mb);
+}
+
+static void rescan_mailbox(struct mailbox* mb)
+{
+	if(mb->type == MAILDIR)
+		scan_maildir(mb);
+	else
+		check_mbox(mb);
+}
+
+static int same_time(struct timespec* a, struct timespec* b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+/* Periodic check for boxes with a working watch. */
+
+static void recheck_mailbox(struct mailbox* mb)
+{
+	struct stat st;
+
+	if(mb->type != MAILDIR)
+		check_mbox(mb);
+	else if(stat(mb->dir, &st) < 0 || !same_time(&st.st_mtim, &mb->mtime))
+		scan_maildir(mb);
+}
+
+static char* concat(char* a, char* b)
+{
+	int la = strlen(a);
+	int lb = strlen(b);
+	char* p;
+
+	if(!(p = malloc(la + lb + 1)))
+		err(-1, "malloc");
+
+	memcpy(p, a, la);
+	memcpy(p + la, b, lb + 1);
+
+	return p;
+}
+
+static int is_maildir(char* path)
+{
+	struct stat st;
+	char* new = concat(path, "/new");
+	int ret = stat(new, &st);
+
+	free(new);
+
+	return (ret >= 0 && S_ISDIR(st.st_mode));
+}
+
+static void arm_mailbox(struct mailbox* mb)
+{
+	if(mail_fd < 0)
+		return;
+
+	mb->wd = inotify_add_watch(mail_fd, mb->dir, mb->mask);
+}
+
+static void add_maildir(struct mailbox* mb, char* path)
+{
+	mb->type = MAILDIR;
+	mb->dir = concat(path, "/new");
+	mb->mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+	         | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+	arm_mailbox(mb);
+}
+
+static void add_mbox(struct mailbox* mb, char* path)
+{
+	char* sep = strrchr(path, '/');
+
+	mb->type = MBOX;
+	mb->mask = IN_MODIFY | IN_ATTRIB | IN_ACCESS | IN_CLOSE_WRITE
+	         | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+	         | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+	if(!sep) {
+		mb->dir = ".";
+		mb->name = path;
+	} else if(sep == path) {
+		mb->dir = "/";
+		mb->name = path + 1;
+	} else {
+		*sep = '\0';
+		mb->dir = path;
+		mb->name = sep + 1;
+	}
+
+	arm_mailbox(mb);
+}
+
+static void add_mailbox(char* path)
+{
+	struct mailbox* mb;
+
+	if(!*path)
+		return;
+	if(nboxes >= MAXBOX)
+		return;
+
+	mb = &boxes[nboxes++];
+	mb->wd = -1;
+
+	if(is_maildir(path))
+		add_maildir(mb, path);
+	else
+		add_mbox(mb, path);
+
+	rescan_mailbox(mb);
+}
+
+/* MAILPATH is colon-separated, with optional ?message suffixes
+   for each entry which the shell uses and we don't. */
+
+static void add_mailpath(char* mailpath)
+{
+	char* p = mailpath;
+
+	while(p) {
+		char* q = strchr(p, ':');
+		char* m;
+
+		if(q) *q++ = '\0';
+
+		if((m = strchr(p, '?')))
+			*m = '\0';
+
+		add_mailbox(p);
+
+		p = q;
+	}
+}
+
+static void maildir_event(struct mailbox* mb, struct inotify_event* ev)
+{
+	if(ev->mask & IN_ISDIR)
+		return;
+	if(!ev->len || ev->name[0] == '.')
+		return;
+
+	if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+		mb->count++;
+	else if(!mb->count)
+		;
+	else if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+		mb->count--;
+
+	set_maildir_state(mb);
+}
+
+static void mbox_event(struct mailbox* mb, struct inotify_event* ev)
+{
+	if(!ev->len || strcmp(ev->name, mb->name))
+		return;
+
+	check_mbox(mb);
+}
+
+static void mailbox_event(struct inotify_event* ev)
+{
+	int i, n = nboxes;
+
+	for(i = 0; i < n; i++) {
+		struct mailbox* mb = &boxes[i];
+
+		if(mb->wd != ev->wd)
+			continue;
+
+		if(ev->mask & IN_IGNORED) {
+			mb->wd = -1;
+			arm_mailbox(mb);
+			rescan_mailbox(mb);
+		} else if(ev->mask & IN_MOVE_SELF) {
+			/* the watch follows the directory, not the path */
+			inotify_rm_watch(mail_fd, mb->wd);
+			mb->wd = -1;
+			arm_mailbox(mb);
+			rescan_mailbox(mb);
+		} else if(mb->type == MAILDIR) {
+			maildir_event(mb, ev);
+		} else {
+			mbox_event(mb, ev);
+		}
+	}
+}
+
+static void rescan_all(void)
+{
+	int i, n = nboxes;
+
+	for(i = 0; i < n; i++) {
+		struct mailbox* mb = &boxes[i];
+
+		if(mb->wd < 0)
+			arm_mailbox(mb);
+
+		rescan_mailbox(mb);
+	}
+}
+
+static void handle_mailbox(void* data, uint events)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char *p, *e;
+	int rd;
+
+	while((rd = read(mail_fd, buf, sizeof(buf))) > 0) {
+		p = buf;
+		e = buf + rd;
+
+		while(p < e) {
+			struct inotify_event* ev = (void*)p;
+
+			if(ev->mask & IN_Q_OVERFLOW)
+				rescan_all();
+			else
+				mailbox_event(ev);
+
+			p += sizeof(*ev) + ev->len;
+		}
+	}
+
+	if(rd < 0 && errno != EAGAIN)
+		err(-1, "read inotify");
+}
 
 void init_mailbox(void)
 {
-	MAIL = getenv("MAIL");
+	char* path;
+
+	scale_bitmaps(icons, 2);
+
+	if((path = getenv("MAILPATH")))
+		;
+	else if((path = getenv("MAIL")))
+		;
+	else
+		return;
+
+	if(!(path = strdup(path)))
+		return;
+
+	mail_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	add_mailpath(path);
+
+	if(mail_fd >= 0)
+		add_source(mail_fd, EPOLLIN, handle_mailbox, NULL);
+}
+
+void update_mailbox(void)
+{
+	uint i, n = nboxes;
+
+	ticks++;
+
+	for(i = 0; i < n; i++) {
+		struct mailbox* mb = &boxes[i];
+
+		if(mb->wd < 0 && !(ticks % POLLTICKS)) {
+			arm_mailbox(mb);
+			rescan_mailbox(mb);
+		} else if(mb->wd >= 0 && !(ticks % RECHECK)) {
+			recheck_mailbox(mb);
+		}
+	}
 }
 
-static void draw_box(byte* data, uint w, uint h)
+static void draw_box(struct bitmap* bm)
 {
-	advance(2);
-	bitmap(data, w, h);
-	advance(2 + w);
+	advance(2*scale);
+	bitmap(bm->data, bm->w, bm->h);
+	advance(2*scale + bm->w);
 }
 
 static void draw_new_mailbox(void)
 {
 	setcolor(0x00A800);
-	draw_box(mn_bits, mn_width, mn_height);
+	draw_box(&icons[NEWICON]);
 }
 
 static void draw_old_mailbox(void)
 {
 	setcolor(0x666666);
-	draw_box(mo_bits, mo_width, mo_height);
+	draw_box(&icons[OLDICON]);
 }
 
-void put_mailbox(void)
+static uint mailbox_state(void)
 {
-	char* name = MAIL;
-	struct stat st;
+	uint i, n = nboxes;
+	uint state = EMPTY;
 
-	if(!name)
-		return;
+	for(i = 0; i < n; i++)
+		if(boxes[i].state > state)
+			state = boxes[i].state;
 
-	if(stat(name, &st) < 0)
-		return;
+	return state;
+}
 
-	if(!st.st_size)
-		return;
-	if(st.st_atime < st.st_mtime)
+uint64_t key_mailbox(void)
+{
+	return mailbox_state();
+}
+
+void put_mailbox(void)
+{
+	uint state = mailbox_state();
+
+	if(state == NEW)
 		draw_new_mailbox();
-	else
+	else if(state == OLD)
 		draw_old_mailbox();
 }
@@ -0,0 +1,229 @@
+#include <unistd.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Memory usage bars (used, cache, available) and swap activity graph.
+
+   Both /proc/meminfo and /proc/vmstat are read into growable buffers,
+   vmstat alone is well over databuf size. Each file gets parsed in one
+   pass that only looks at the keys listed in the tables below, and stops
+   as soon as all of them have been found. */
+
+#define GRAPHW 30
+#define S scale
+#define BARW (4*S)
+
+struct field {
+	char* key;
+	uint len;
+	uint64_t* val;
+};
+
+#define FIELD(name, var) { name, sizeof(name) - 1, &var }
+
+static struct meminfo {
+	uint64_t total;
+	uint64_t free;
+	uint64_t avail;
+	uint64_t buffers;
+	uint64_t cached;
+	uint64_t sreclaim;
+} mi;
+
+static struct vmstat {
+	uint64_t pswpin;
+	uint64_t pswpout;
+	uint64_t majflt;
+} vm, vmprev;
+
+static const struct field meminfo_fields[] = {
+	FIELD("MemTotal", mi.total),
+	FIELD("MemFree", mi.free),
+	FIELD("MemAvailable", mi.avail),
+	FIELD("Buffers", mi.buffers),
+	FIELD("Cached", mi.cached),
+	FIELD("SReclaimable", mi.sreclaim)
+};
+
+static const struct field vmstat_fields[] = {
+	FIELD("pswpin", vm.pswpin),
+	FIELD("pswpout", vm.pswpout),
+	FIELD("pgmajfault", vm.majflt)
+};
+
+#define NFIELDS(f) (sizeof(f)/sizeof(*f))
+
+static struct buffer meminfo_buf;
+static struct buffer vmstat_buf;
+
+static struct mempt {
+	byte in;
+	byte out;
+	byte flt;
+} graph[GRAPHW];
+
+static uint graphptr;
+static uint primed;
+
+static char* match_field(char* p, const struct field* f)
+{
+	uint len = f->len;
+	char c;
+
+	if(p[0] != f->key[0])
+		return NULL;
+	if(strncmp(p, f->key, len))
+		return NULL;
+
+	if((c = p[len]) == ':')
+		len++;
+	else if(c != ' ')
+		return NULL;
+
+	return skip_space(p + len);
+}
+
+static void parse_fields(struct buffer* bf, const struct field* fs, uint n)
+{
+	char* p = bf->data;
+	char* e = p + bf->len;
+	uint left = n;
+	uint found = 0;
+
+	while(p < e && left) {
+		char* q = skip_to_eol(p, e);
+		char* v;
+
+		if(!q) break;
+
+		for(uint i = 0; i < n; i++) {
+			const struct field* f = &fs[i];
+
+			if(found & (1 << i))
+				continue;
+			if(!(v = match_field(p, f)))
+				continue;
+
+			*(f->val) = 0;
+			parse_add(v, f->val);
+
+			found |= (1 << i);
+			left--;
+			break;
+		}
+
+		p = q + 1;
+	}
+}
+
+static void add_graph_point(void)
+{
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t in = (vm.pswpin - vmprev.pswpin)*page;
+	uint64_t out = (vm.pswpout - vmprev.pswpout)*page;
+	uint64_t flt = (vm.majflt - vmprev.majflt)*page;
+
+	struct mempt* pt = &graph[graphptr];
+
+	uint bar = log_scale(in + out);
+	uint gout = calc_txbar(in, out, bar);
+
+	pt->out = gout;
+	pt->in = bar - gout;
+	pt->flt = log_scale(flt);
+
+	xps.swap_in = dtms ? in*1000/dtms : 0;
+	xps.swap_out = dtms ? out*1000/dtms : 0;
+
+	graphptr = (graphptr + 1) % GRAPHW;
+}
+
+void update_memory(void)
+{
+	if(load_buffer("/proc/meminfo", &meminfo_buf) >= 0) {
+		parse_fields(&meminfo_buf, meminfo_fields, NFIELDS(meminfo_fields));
+
+		xps.mem_total = 1024*mi.total;
+		xps.mem_avail = 1024*mi.avail;
+		xps.mem_cache = 1024*(mi.buffers + mi.cached + mi.sreclaim);
+	}
+
+	if(load_buffer("/proc/vmstat", &vmstat_buf) < 0)
+		return;
+
+	vmprev = vm;
+
+	parse_fields(&vmstat_buf, vmstat_fields, NFIELDS(vmstat_fields));
+
+	if(primed++)
+		add_graph_point();
+}
+
+static void draw_bar(uint x, uint64_t val)
+{
+	uint h = pix_height;
+	uint bh = mi.total ? val*h/mi.total : 0;
+
+	if(bh > h) bh = h;
+
+	fillrec(x, h - bh, BARW, bh);
+}
+
+static void redraw_bars(void)
+{
+	uint64_t cache = mi.buffers + mi.cached + mi.sreclaim;
+	uint64_t used = mi.total - mi.free;
+
+	if(used > cache)
+		used -= cache;
+	else
+		used = 0;
+
+	setcolor(0x4040A0);
+	draw_bar(0, used);
+
+	setcolor(0x555555);
+	draw_bar(BARW + S, cache);
+
+	setcolor(0x007000);
+	draw_bar(2*(BARW + S), mi.avail);
+}
+
+static void redraw_graph(uint x0)
+{
+	uint i, w = GRAPHW;
+
+	for(i = 0; i < w; i++) {
+		uint k = (graphptr + i) % GRAPHW;
+		struct mempt* pt = &graph[k];
+
+		uint in = pt->in;
+		uint out = pt->out;
+		uint x = x0 + S*i;
+
+		setcolor(0x333333);
+		column(x, 0, pt->flt);
+
+		setcolor(0xB4893B);
+		column(x, 0, out);
+
+		setcolor(0xA91598);
+		column(x, out, out + in);
+	}
+}
+
+void put_memory(void)
+{
+	uint bars = 3*(BARW + S);
+
+	if(!mi.total)
+		return;
+
+	advance(2*S);
+
+	redraw_bars();
+	redraw_graph(bars + S);
+
+	advance(bars + S*(1 + GRAPHW + 2));
+}
@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Network protocol health graph: TCP retransmits, receive errors and
+   listen queue drops, and softnet backlog drops/squeezes, per second.
+   A healthy box shows nothing here, any pixel lit means trouble.
+
+   /proc/net/snmp and /proc/net/netstat come in header/value row pairs,
+   with the set and order of columns depending on the kernel version.
+   The header rows are only tokenized when they change (which normally
+   means never after startup), and the wanted column numbers are kept.
+   Each tick then only walks the value rows up to the last needed
+   column, comparing field numbers instead of names. */
+
+#define GRAPHW 30
+
+#define S scale
+
+static struct table {
+	char* name;
+	char* group;
+	struct buffer buf;
+	char* header;
+	uint hdrlen;
+	uint last; /* highest wanted column */
+} tables[] = {
+	{ "/proc/net/snmp",    "Tcp: " },
+	{ "/proc/net/netstat", "TcpExt: " }
+};
+
+#define NTABLES (sizeof(tables)/sizeof(*tables))
+
+static struct column {
+	uint table;
+	char* key;
+	uint idx; /* 1-based, 0 if not found */
+	uint64_t val;
+	uint64_t prev;
+} columns[] = {
+	{ 0, "RetransSegs" },
+	{ 0, "InErrs" },
+	{ 1, "ListenDrops" }
+};
+
+#define NCOLUMNS (sizeof(columns)/sizeof(*columns))
+
+#define RETRANS  0
+#define INERRS   1
+#define LDROPS   2
+
+static struct buffer softbuf;
+
+static struct softnet {
+	uint64_t drops;
+	uint64_t squeeze;
+} sn, snprev;
+
+static struct healthpt {
+	byte retr;
+	byte errs;
+	byte soft;
+} graph[GRAPHW];
+
+static uint graphptr;
+static uint primed;
+static uint active;
+
+static uint find_column(char* p, char* key)
+{
+	uint len = strlen(key);
+	uint i = 1;
+
+	while(*(p = skip_space(p))) {
+		char* q = skip_word(p);
+
+		if(q - p == len && !memcmp(p, key, len))
+			return i;
+
+		p = q;
+		i++;
+	}
+
+	return 0;
+}
+
+static void index_header(struct table* tb, uint t, char* p)
+{
+	uint i;
+
+	tb->last = 0;
+
+	for(i = 0; i < NCOLUMNS; i++) {
+		struct column* cl = &columns[i];
+
+		if(cl->table != t)
+			continue;
+
+		cl->idx = find_column(p, cl->key);
+		cl->prev = cl->val = 0;
+
+		if(cl->idx > tb->last)
+			tb->last = cl->idx;
+	}
+
+	primed = 0; /* counters restarted in effect */
+}
+
+static void check_header(struct table* tb, uint t, char* p)
+{
+	uint len = strlen(p);
+
+	if(tb->header && len == tb->hdrlen && !memcmp(tb->header, p, len))
+		return;
+
+	free(tb->header);
+
+	if(!(tb->header = strdup(p)))
+		tb->hdrlen = 0;
+	else
+		tb->hdrlen = len;
+
+	index_header(tb, t, p);
+}
+
+static void parse_values(struct table* tb, uint t, char* p)
+{
+	uint i, k;
+
+	for(i = 1; i <= tb->last && *(p = skip_space(p)); i++) {
+		for(k = 0; k < NCOLUMNS; k++) {
+			struct column* cl = &columns[k];
+
+			if(cl->table != t || cl->idx != i)
+				continue;
+
+			cl->prev = cl->val;
+			cl->val = 0;
+			parse_add(p, &cl->val);
+		}
+
+		p = skip_word(p);
+	}
+}
+
+/* The first row with the group tag is the header, the second one
+   is the values. Everything else in the file gets skipped. */
+
+static void parse_table(struct table* tb, uint t)
+{
+	char* p = tb->buf.data;
+	char* e = p + tb->buf.len;
+	uint glen = strlen(tb->group);
+	uint row = 0;
+
+	while(p < e && row < 2) {
+		char* q = skip_to_eol(p, e);
+
+		if(!q) break;
+
+		*q = '\0';
+
+		if(!strncmp(p, tb->group, glen)) {
+			if(!row++)
+				check_header(tb, t, p + glen);
+			else
+				parse_values(tb, t, p + glen);
+		}
+
+		p = q + 1;
+	}
+}
+
+static char* parse_hex(char* p, uint64_t* v)
+{
+	uint64_t r = 0;
+	char c;
+
+	while((c = *p)) {
+		if(c >= '0' && c <= '9')
+			r = (r << 4) | (c - '0');
+		else if(c >= 'a' && c <= 'f')
+			r = (r << 4) | (c - 'a' + 10);
+		else
+			break;
+		p++;
+	}
+
+	*v += r;
+
+	return skip_space(p);
+}
+
+/* One row per CPU, all hex: processed dropped time_squeeze ... */
+
+static void parse_softnet(void)
+{
+	char* p = softbuf.data;
+	char* e = p + softbuf.len;
+	uint64_t skip = 0;
+
+	snprev = sn;
+	memset(&sn, 0, sizeof(sn));
+
+	while(p < e) {
+		char* q = skip_to_eol(p, e);
+
+		if(!q) break;
+
+		*q = '\0';
+
+		p = parse_hex(p, &skip);
+		p = parse_hex(p, &sn.drops);
+		p = parse_hex(p, &sn.squeeze);
+
+		p = q + 1;
+	}
+}
+
+/* Per-CPU rows come and go with hotplug, the sums may go down. */
+
+static uint64_t delta(uint64_t val, uint64_t prev)
+{
+	return val > prev ? val - prev : 0;
+}
+
+static uint64_t column_rate(uint i)
+{
+	struct column* cl = &columns[i];
+
+	if(!cl->idx)
+		return 0;
+
+	return delta(cl->val, cl->prev)*1000/dtms;
+}
+
+/* 1 pixel per power of two, so a single event is already visible. */
+
+static uint rate_height(uint64_t rate)
+{
+	uint h = 0;
+
+	while(rate) {
+		h++;
+		rate >>= 1;
+	}
+
+	return h;
+}
+
+static void add_graph_point(void)
+{
+	struct healthpt* pt = &graph[graphptr];
+	uint64_t soft = delta(sn.drops, snprev.drops)
+	              + delta(sn.squeeze, snprev.squeeze);
+	uint max = pix_height / 3;
+	uint retr = rate_height(column_rate(RETRANS));
+	uint errs = rate_height(column_rate(INERRS) + column_rate(LDROPS));
+	uint sbar = rate_height(soft*1000/dtms);
+
+	pt->retr = retr > max ? max : retr;
+	pt->errs = errs > max ? max : errs;
+	pt->soft = sbar > max ? max : sbar;
+
+	graphptr = (graphptr + 1) % GRAPHW;
+}
+
+void update_nethealth(void)
+{
+	uint t;
+
+	active = 0;
+
+	for(t = 0; t < NTABLES; t++) {
+		struct table* tb = &tables[t];
+
+		if(load_buffer(tb->name, &tb->buf) < 0)
+			continue;
+
+		parse_table(tb, t);
+		active = 1;
+	}
+
+	if(load_buffer("/proc/net/softnet_stat", &softbuf) >= 0)
+		parse_softnet();
+
+	if(!active || !dtms)
+		return;
+
+	if(primed++)
+		add_graph_point();
+}
+
+static void draw_run(uint x, uint* y, uint n, uint color)
+{
+	if(!n) return;
+
+	setcolor(color);
+	column(x, *y, *y + n);
+
+	*y += n;
+}
+
+void put_nethealth(void)
+{
+	uint i, w = GRAPHW;
+
+	if(!active)
+		return;
+
+	for(i = 0; i < w; i++) {
+		uint k = (graphptr + i) % GRAPHW;
+		struct healthpt* pt = &graph[k];
+		uint x = S*(1 + i);
+		uint y = 0;
+
+		draw_run(x, &y, pt->soft, 0xA91598);
+		draw_run(x, &y, pt->errs, 0xFF2020);
+		draw_run(x, &y, pt->retr, 0xE0A000);
+	}
+
+	advance(S*(w + 2));
+}
@@ -8,6 +8,9 @@
 
 #define MAXDEV 4
 #define GRAPHW 60
+#define GRAPHTIER 0
+
+#define S scale
 
 #define MISSING 0
 #define PRESENT 1
@@ -19,14 +22,6 @@ static struct netdev {
 
 	uint64_t rx;
 	uint64_t tx;
-
-	uint ptr;
-
-	struct netpt {
-		byte rx;
-		byte tx;
-	} graph[GRAPHW];
-
 } netdevs[MAXDEV];
 
 static int sockfd;
@@ -71,37 +66,6 @@ static struct netdev* grab_device_slot(char* ifn)
 	return NULL;
 }
 
-uint binlog(uint64_t v)
-{
-	uint ret = 0;
-
-	while(v) {
-		ret++;
-		v = v >> 1;
-	}
-
-	return ret;
-}
-
-uint log_scale(uint64_t total)
-{
-	if(!total)
-		return 0;
-
-	uint log = binlog(total);
-
-	if(log < 8)
-		return 1;
-
-	uint max = pix_height - 1;
-	uint bar = log - 7;
-
-	if(bar >= max)
-		return max;
-
-	return bar;
-}
-
 static int socket_fd(void)
 {
 	int fd;
@@ -136,24 +100,18 @@ static uint get_dev_flags(char* ifn)
 	return ifr.ifr_ifru.ifru_ivalue;
 }
 
-uint calc_txbar(uint64_t rx, uint64_t tx, uint bar)
+static void export_rates(struct netdev* nd, uint64_t drx, uint64_t dtx)
 {
-	uint64_t total = rx + tx;
-
-	if(!total) return 0;
-
-	uint txbar = (bar*tx)/total;
-
-	if(bar == 1)
-		return rx > tx ? 0 : 1;
+	struct xpstat_net* xn = &xps.net[nd - netdevs];
 
-	if(txbar > bar)
-		txbar = bar;
+	memcpy(xn->name, nd->ifname, sizeof(xn->name));
 
-	return txbar;
+	xn->state = nd->active;
+	xn->rx = dtms ? drx*1000/dtms : 0;
+	xn->tx = dtms ? dtx*1000/dtms : 0;
 }
 
-static void add_graph_point(char* ifn, uint64_t rx, uint64_t tx)
+static void update_device(char* ifn, uint64_t rx, uint64_t tx)
 {
 	struct netdev* nd;
 	uint64_t drx, dtx;
@@ -181,18 +139,7 @@ static void add_graph_point(char* ifn, uint64_t rx, uint64_t tx)
 	else
 		nd->active = PRESENT;
 
-	uint ptr = nd->ptr;
-
-	uint bar = log_scale(drx + dtx);
-	uint gtx = calc_txbar(drx, dtx, bar);
-	uint grx = bar - gtx;
-
-	struct netpt* pt = &nd->graph[ptr];
-
-	pt->rx = grx;
-	pt->tx = gtx;
-
-	nd->ptr = (ptr + 1) % GRAPHW;
+	export_rates(nd, drx, dtx);
 }
 
 static void parse_net_line(char* p)
@@ -220,7 +167,7 @@ static void parse_net_line(char* p)
 	if(!(p = parse_add(p, &tx)))
 		return;
 
-	add_graph_point(ifn, rx, tx);
+	update_device(ifn, rx, tx);
 }
 
 static void parse_net_stats(void)
@@ -274,54 +221,56 @@ static void drop_stale_entries(void)
 			continue;
 
 		memset(nd, 0, sizeof(*nd));
+		memset(&xps.net[i], 0, sizeof(xps.net[i]));
 	}
 }
 
-static void redraw_net_graph(struct netdev* nd)
+/* The graph is drawn from history.c, which only has the totals over
+   all devices, so there is one graph however many are up. History has
+   rates per second, the scale is for bytes per 0.5s tick. */
+
+static void redraw_net_graph(void)
 {
+	struct histval hrx, htx;
 	uint i, w = GRAPHW;
-	uint h = pix_height;
 
 	for(i = 0; i < w; i++) {
-		uint ptr = nd->ptr;
-		uint k = (ptr + i + 1) % GRAPHW;
-		struct netpt* pt = &nd->graph[k];
+		uint back = w - i - 1;
 
-		uint rx = pt->rx;
-		uint tx = pt->tx;
+		if(get_history(GRAPHTIER, HS_NETRX, back, &hrx) < 0)
+			continue;
+		if(get_history(GRAPHTIER, HS_NETTX, back, &htx) < 0)
+			continue;
 
-		uint y = 0;
-		uint x = 1 + i;
+		uint64_t drx = hrx.avg / 2;
+		uint64_t dtx = htx.avg / 2;
 
-		setcolor(0xB4893B);
+		uint bar = log_scale(drx + dtx);
+		uint tx = calc_txbar(drx, dtx, bar);
+		uint rx = bar - tx;
 
-		while(tx-- > 0)
-			point(x, h - y++ - 1);
+		uint x = S*(1 + i);
 
-		setcolor(0xA91598);
+		setcolor(0xB4893B);
+		column(x, 0, tx);
 
-		while(rx-- > 0)
-			point(x, h - y++ - 1);
+		setcolor(0xA91598);
+		column(x, tx, tx + rx);
 	}
 
-	advance(w + 2);
+	advance(S*(w + 2));
 }
 
-static void redraw_net_graphs(void)
+static int any_running(void)
 {
-	uint i, n = MAXDEV;
+	for(uint i = 0; i < MAXDEV; i++)
+		if(netdevs[i].active == RUNNING)
+			return 1;
 
-	for(i = 0; i < n; i++) {
-		struct netdev* nd = &netdevs[i];
-
-		if(nd->active != RUNNING)
-			continue;
-
-		redraw_net_graph(nd);
-	}
+	return 0;
 }
 
-void put_netload(void)
+void update_netload(void)
 {
 	if(load_file("/proc/net/dev") < 0)
 		return;
@@ -331,6 +280,10 @@ void put_netload(void)
 	parse_net_stats();
 
 	drop_stale_entries();
+}
 
-	redraw_net_graphs();
+void put_netload(void)
+{
+	if(any_running())
+		redraw_net_graph();
 }
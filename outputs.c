@@ -0,0 +1,574 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <xcb/randr.h>
+
+#include "common.h"
+#include "panel.h"
+
+/* One panel window per monitor, all showing the same image.
+
+   Sampling and rendering happen once per tick regardless of the number
+   of monitors. Each extra window only costs one more copy_area from the
+   same SHM pixmap, clipped to the same damage.
+
+   The main panel window (panwin) stays where the WM docks it, and is
+   the only one with the systray. Whichever output panwin is actually on
+   is left to it, which is not necessarily the RandR primary one. Every
+   other output gets an override-redirect window in its bottom right
+   corner, showing only the widgets, so they are pix_wused wide.
+
+   Override-redirect windows are not managed by the WM. They reserve no
+   space on their outputs the way the dock does, _NET_WM_STRUT_PARTIAL
+   only applies to managed windows, and other windows may end up on top
+   of them, maximized ones in particular.
+
+   Outputs are active RandR CRTCs, with mirrors (CRTCs at the same origin)
+   collapsed into one. Screen change events cause a full rescan, panwin
+   getting moved or reparented only a new choice of its output, and
+   windows get created, moved or destroyed to match. Without RandR,
+   or without any active CRTCs, there is only panwin.
+
+   Except for the initial scan, nothing here waits for a reply. Requests
+   go out from the event handlers, and check_outputs() picks up whatever
+   replies have arrived once per loop pass. A rescan takes two round
+   trips, screen resources first, then all CRTCs at once. */
+
+#define MAXCRTC 16
+#define MAXOUT 8
+
+struct output {
+	xcb_randr_crtc_t crtc;
+	xcb_window_t win;
+	int x, y;
+	uint w, h;
+	uint width; /* of the window */
+};
+
+static struct output outputs[MAXOUT]; /* [0] is panwin */
+static uint nouts;
+
+static struct output screens[MAXOUT]; /* from the last scan */
+static uint nscreens;
+static xcb_randr_crtc_t primary;
+
+static int randr_event = -1;
+
+#define NONE 0
+#define SENT 1
+#define DONE 2
+
+struct pending {
+	uint seq;
+	uint state;
+	void* reply;
+};
+
+#define RESOURCES 1 /* waiting for screen resources and primary output */
+#define CRTCS 2     /* waiting for CRTC info and primary output info */
+
+static uint scanning;
+
+static struct pending res_reply;
+static struct pending pri_reply;
+static struct pending info_reply;
+static struct pending crtc_replies[MAXCRTC];
+static xcb_randr_crtc_t crtc_ids[MAXCRTC];
+static uint ncrtcs;
+
+static struct pending pos_reply;
+static int panx, pany; /* of panwin, in root coordinates */
+static uint panknown;
+
+static void forget(struct pending* pd)
+{
+	if(pd->state == SENT)
+		xcb_discard_reply(conn, pd->seq);
+	else if(pd->state == DONE)
+		free(pd->reply);
+
+	pd->state = NONE;
+	pd->reply = NULL;
+}
+
+static void expect(struct pending* pd, uint seq)
+{
+	forget(pd);
+
+	pd->seq = seq;
+	pd->state = SENT;
+}
+
+/* Returns 0 while the reply is still on its way, unless told to wait.
+   Errors leave a NULL reply. */
+
+static int collect(struct pending* pd, int wait)
+{
+	xcb_generic_error_t* error = NULL;
+
+	if(pd->state != SENT)
+		return 1;
+
+	if(wait)
+		pd->reply = xcb_wait_for_reply(conn, pd->seq, &error);
+	else if(!xcb_poll_for_reply(conn, pd->seq, &pd->reply, &error))
+		return 0;
+
+	free(error);
+
+	pd->state = DONE;
+
+	return 1;
+}
+
+static void forget_scan(void)
+{
+	for(uint i = 0; i < ncrtcs; i++)
+		forget(&crtc_replies[i]);
+
+	forget(&res_reply);
+	forget(&pri_reply);
+	forget(&info_reply);
+
+	ncrtcs = 0;
+	scanning = 0;
+}
+
+static void request_outputs(void)
+{
+	xcb_window_t root = screen->root;
+
+	forget_scan();
+
+	expect(&res_reply,
+		xcb_randr_get_screen_resources_current(conn, root).sequence);
+	expect(&pri_reply,
+		xcb_randr_get_output_primary(conn, root).sequence);
+
+	scanning = RESOURCES;
+}
+
+static void request_position(void)
+{
+	expect(&pos_reply,
+		xcb_translate_coordinates(conn, panwin, screen->root, 0, 0).sequence);
+}
+
+void query_outputs(void)
+{
+	const xcb_query_extension_reply_t* ext;
+
+	ext = xcb_get_extension_data(conn, &xcb_randr_id);
+
+	if(!ext || !ext->present)
+		return;
+
+	randr_event = ext->first_event;
+
+	xcb_randr_select_input(conn, screen->root,
+			XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
+
+	request_outputs();
+	request_position();
+}
+
+static int same_origin(struct output* found, uint n, int x, int y)
+{
+	for(uint i = 0; i < n; i++)
+		if(found[i].x == x && found[i].y == y)
+			return 1;
+
+	return 0;
+}
+
+static uint add_output(struct output* found, uint n, xcb_randr_crtc_t crtc,
+                       xcb_randr_get_crtc_info_reply_t* ci)
+{
+	if(!ci->mode || !ci->width || !ci->height)
+		return n;
+	if(same_origin(found, n, ci->x, ci->y))
+		return n;
+	if(n >= MAXOUT)
+		return n;
+
+	found[n].crtc = crtc;
+	found[n].x = ci->x;
+	found[n].y = ci->y;
+	found[n].w = ci->width;
+	found[n].h = ci->height;
+
+	return n + 1;
+}
+
+static void place_window(struct output* op)
+{
+	uint mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y
+	          | XCB_CONFIG_WINDOW_WIDTH;
+	uint width = op->width ? op->width : pix_height;
+	uint x = op->x + op->w - width;
+	uint y = op->y + op->h - pix_height;
+	uint values[3] = { x, y, width };
+
+	xcb_configure_window(conn, op->win, mask, values);
+}
+
+static xcb_window_t create_window(struct output* op)
+{
+	uint mask = XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT
+	          | XCB_CW_EVENT_MASK;
+	uint values[3] = { screen->black_pixel, 1, XCB_EVENT_MASK_EXPOSURE };
+	xcb_window_t win = xcb_generate_id(conn);
+
+	xcb_create_window(conn,
+	                  screen->root_depth,
+	                  win,
+	                  screen->root,
+	                  op->x + op->w - pix_height, op->y + op->h - pix_height,
+	                  pix_height, pix_height, 0,
+	                  XCB_WINDOW_CLASS_INPUT_OUTPUT,
+	                  screen->root_visual,
+	                  mask, values);
+
+	xcb_map_window(conn, win);
+
+	return win;
+}
+
+static struct output* find_output(xcb_randr_crtc_t crtc)
+{
+	for(uint i = 1; i < nouts; i++)
+		if(outputs[i].crtc == crtc)
+			return &outputs[i];
+
+	return NULL;
+}
+
+/* Windows for outputs that are still there get reused, the rest get
+   destroyed, and new outputs get new windows. */
+
+static void apply_outputs(struct output* found, uint nfound)
+{
+	struct output next[MAXOUT];
+	struct output* op;
+	uint i;
+
+	memset(next, 0, sizeof(next));
+
+	next[0] = found[0];
+	next[0].win = panwin;
+
+	for(i = 1; i < nfound; i++) {
+		struct output* np = &next[i];
+
+		*np = found[i];
+
+		if(!(op = find_output(np->crtc))) {
+			np->win = create_window(np);
+			continue;
+		}
+
+		np->win = op->win;
+		np->width = op->width;
+		op->win = 0;
+
+		if(op->x != np->x || op->y != np->y)
+			place_window(np);
+		else if(op->w != np->w || op->h != np->h)
+			place_window(np);
+	}
+
+	for(i = 1; i < nouts; i++)
+		if(outputs[i].win)
+			xcb_destroy_window(conn, outputs[i].win);
+
+	memcpy(outputs, next, sizeof(outputs));
+	nouts = nfound;
+}
+
+static int contains(struct output* op, int x, int y)
+{
+	return x >= op->x && x < op->x + (int)op->w
+	    && y >= op->y && y < op->y + (int)op->h;
+}
+
+/* The output panwin is on, by its last known position on the root
+   window. Before the WM gets to place it, that may be anywhere, so the
+   primary one is the fallback. */
+
+static uint panel_screen(void)
+{
+	uint i;
+
+	if(panknown)
+		for(i = 0; i < nscreens; i++)
+			if(contains(&screens[i], panx, pany))
+				return i;
+
+	for(i = 0; i < nscreens; i++)
+		if(screens[i].crtc == primary)
+			return i;
+
+	return 0;
+}
+
+/* With no outputs at all, panwin alone still goes through apply_outputs()
+   so that the other windows get destroyed. */
+
+static void arrange_outputs(void)
+{
+	struct output found[MAXOUT];
+	uint i, first, nfound = 1;
+
+	memset(found, 0, sizeof(found));
+
+	if(!nscreens) {
+		apply_outputs(found, 1);
+		return;
+	}
+
+	first = panel_screen();
+
+	found[0] = screens[first];
+
+	for(i = 0; i < nscreens; i++)
+		if(i != first)
+			found[nfound++] = screens[i];
+
+	apply_outputs(found, nfound);
+}
+
+/* The primary output's CRTC gets asked for along with the CRTC info,
+   all of it needs config_timestamp from the resources reply. */
+
+static void request_crtcs(void)
+{
+	xcb_randr_get_screen_resources_current_reply_t* res = res_reply.reply;
+	xcb_randr_get_output_primary_reply_t* pri = pri_reply.reply;
+	xcb_timestamp_t ts;
+	xcb_randr_crtc_t* crtcs;
+	uint i, n;
+
+	if(!res) {
+		forget_scan();
+		return;
+	}
+
+	ts = res->config_timestamp;
+	crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+	n = xcb_randr_get_screen_resources_current_crtcs_length(res);
+
+	if(n > MAXCRTC)
+		n = MAXCRTC;
+
+	for(i = 0; i < n; i++) {
+		crtc_ids[i] = crtcs[i];
+		expect(&crtc_replies[i],
+			xcb_randr_get_crtc_info(conn, crtcs[i], ts).sequence);
+	}
+
+	ncrtcs = n;
+
+	if(pri && pri->output)
+		expect(&info_reply,
+			xcb_randr_get_output_info(conn, pri->output, ts).sequence);
+
+	scanning = CRTCS;
+}
+
+static void finish_scan(void)
+{
+	xcb_randr_get_output_info_reply_t* info = info_reply.reply;
+	xcb_randr_get_crtc_info_reply_t* ci;
+	uint i;
+
+	primary = info ? info->crtc : 0;
+
+	memset(screens, 0, sizeof(screens));
+	nscreens = 0;
+
+	for(i = 0; i < ncrtcs; i++)
+		if((ci = crtc_replies[i].reply))
+			nscreens = add_output(screens, nscreens, crtc_ids[i], ci);
+
+	forget_scan();
+}
+
+/* Returns 1 once the scan is complete. A failed one keeps
+   the outputs from the last scan. */
+
+static int advance_scan(int wait)
+{
+	uint i;
+
+	if(scanning == RESOURCES) {
+		if(!collect(&res_reply, wait) || !collect(&pri_reply, wait))
+			return 0;
+
+		request_crtcs();
+	}
+
+	if(scanning != CRTCS)
+		return 0;
+
+	for(i = 0; i < ncrtcs; i++)
+		if(!collect(&crtc_replies[i], wait))
+			return 0;
+
+	if(!collect(&info_reply, wait))
+		return 0;
+
+	finish_scan();
+
+	return 1;
+}
+
+static int take_position(int wait)
+{
+	xcb_translate_coordinates_reply_t* tr;
+
+	if(pos_reply.state != SENT)
+		return 0;
+	if(!collect(&pos_reply, wait))
+		return 0;
+
+	if((tr = pos_reply.reply)) {
+		panx = tr->dst_x;
+		pany = tr->dst_y;
+		panknown = 1;
+	}
+
+	forget(&pos_reply);
+
+	return !!tr;
+}
+
+static void rearrange(int redraw)
+{
+	xcb_randr_crtc_t was = outputs[0].crtc;
+
+	arrange_outputs();
+
+	if(redraw || outputs[0].crtc != was)
+		redraw_window();
+}
+
+void init_outputs(void)
+{
+	if(randr_event < 0)
+		return;
+
+	advance_scan(1);
+	take_position(1);
+
+	arrange_outputs();
+}
+
+void check_outputs(void)
+{
+	int scanned, moved;
+
+	if(randr_event < 0)
+		return;
+
+	scanned = advance_scan(0);
+	moved = take_position(0);
+
+	if(scanned || moved)
+		rearrange(scanned);
+}
+
+int handle_randr_event(xcb_generic_event_t* ev)
+{
+	uint type = ev->response_type & 0x7F;
+
+	if(randr_event < 0)
+		return 0;
+	if(type != randr_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+		return 0;
+
+	request_outputs();
+	request_position();
+
+	return 1;
+}
+
+/* The RandR state is still the same, only the choice of panwin's
+   output may need to change. Docking means a reparent, and the dock
+   maps panwin once it has been placed. Moving the dock later does not
+   get reported to panwin itself, only through the synthetic configure
+   notify ICCCM asks the WM to send in that case, and that one comes
+   with root coordinates. Real configure notifies are relative to the
+   parent, so those need a round trip to find where panwin is. */
+
+int handle_panel_moved(xcb_generic_event_t* ev)
+{
+	uint type = ev->response_type & 0x7F;
+	xcb_configure_notify_event_t* cn = (void*)ev;
+	xcb_window_t win;
+
+	if(randr_event < 0)
+		return 0;
+
+	if(type == XCB_CONFIGURE_NOTIFY)
+		win = cn->window;
+	else if(type == XCB_REPARENT_NOTIFY)
+		win = ((xcb_reparent_notify_event_t*)ev)->window;
+	else if(type == XCB_MAP_NOTIFY)
+		win = ((xcb_map_notify_event_t*)ev)->window;
+	else
+		return 0;
+
+	if(win != panwin)
+		return 0;
+
+	if(type == XCB_CONFIGURE_NOTIFY && (ev->response_type & 0x80)) {
+		panx = cn->x;
+		pany = cn->y;
+		panknown = 1;
+		rearrange(0);
+	} else {
+		request_position();
+	}
+
+	return 1;
+}
+
+int output_window(xcb_window_t win)
+{
+	for(uint i = 1; i < nouts; i++)
+		if(outputs[i].win == win)
+			return 1;
+
+	return 0;
+}
+
+/* The windows are anchored by their right edges, so resizing
+   moves them as well. */
+
+void resize_outputs(uint width)
+{
+	if(!width)
+		return;
+
+	for(uint i = 1; i < nouts; i++) {
+		struct output* op = &outputs[i];
+
+		if(op->width == width)
+			continue;
+
+		op->width = width;
+
+		place_window(op);
+	}
+}
+
+/* Same area of the same pixmap, without the systray offset. */
+
+void copy_outputs(int sx, int sy, int w, int h)
+{
+	for(uint i = 1; i < nouts; i++)
+		xcb_copy_area(conn, pix, outputs[i].win, gc,
+				sx, sy, sx, sy, w, h);
+}
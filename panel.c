@@ -1,17 +1,20 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/timerfd.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <poll.h>
+#include <string.h>
 #include <err.h>
 
 #include <xcb/xcb.h>
 #include <xcb/shm.h>
+#include <xcb/randr.h>
 #include <xcb/xcb_image.h>
 
 #include "common.h"
 #include "panel.h"
+#include "probes.h"
 
 uint timer_fd;
 uint xconn_fd;
@@ -25,26 +28,44 @@ xcb_pixmap_t pix;
 uint dtms;
 struct timespec prevtime;
 
+struct sample sample;
+
 char databuf[2048];
 uint datalen;
 
 uint win_width;
 uint win_height;
 uint win_mapped;
+uint need_redraw;
+uint xevents;
 
 uint pix_width;
 uint pix_height;
 uint pix_wused;
+uint scale = 1;
+
+byte* image;
+uint pix_bytes = 4;
+
+static xcb_shm_query_version_cookie_t shm_cookie;
+static xcb_get_property_cookie_t xrm_cookie;
+static uint pix_align = 1; /* columns, see init_pixfmt() */
+static int timing;
+static struct timespec t_start;
+
+static struct probe batch_probe = { "batch", "read" };
+static struct probe frame_probe = { "frame", "total" };
+static struct probe repaint_probe = { "window", "copy" };
+static struct probe flush_probe = { "xcb", "flush" };
 
-uint* image;
+static void check_xconn(void* data, uint events);
 
 static void clear_image(void)
 {
 	uint w = pix_width;
 	uint h = pix_height;
 
-	for(uint i = 0; i < w*h; i++)
-		image[i] = 0;
+	memset(image, 0, w*h*pix_bytes);
 
 	pix_wused = 0;
 }
@@ -61,6 +82,79 @@ static void init_connection(void)
 	screen = iter.data;
 
 	xconn_fd = xcb_get_file_descriptor(conn);
+
+	xcb_prefetch_extension_data(conn, &xcb_shm_id);
+	xcb_prefetch_extension_data(conn, &xcb_randr_id);
+	shm_cookie = xcb_shm_query_version(conn);
+
+	xrm_cookie = xcb_get_property(conn, 0, screen->root,
+			XCB_ATOM_RESOURCE_MANAGER, XCB_ATOM_STRING, 0, 16384);
+
+	add_source(xconn_fd, EPOLLIN, check_xconn, NULL);
+}
+
+/* Integer scale for HiDPI screens, from Xft.dpi if set or the physical
+   screen size otherwise. Everything that depends on it gets prepared
+   once: pix_height is H*scale, glyphs get pre-scaled, and graphs draw
+   natively at the larger height. Nothing scales per pixel. */
+
+#define MAXSCALE 4
+
+static uint xft_dpi(void)
+{
+	xcb_get_property_reply_t* reply;
+	char *p, *e, *q;
+	uint dpi = 0;
+
+	if(!(reply = xcb_get_property_reply(conn, xrm_cookie, NULL)))
+		return 0;
+
+	p = xcb_get_property_value(reply);
+	e = p + xcb_get_property_value_length(reply);
+
+	for(q = e; p < e; p = q + 1) {
+		if(!(q = memchr(p, '\n', e - p)))
+			q = e;
+		if(q - p > 8 && !strncmp(p, "Xft.dpi:", 8))
+			break;
+	}
+
+	if(p >= e)
+		goto out;
+
+	for(p += 8; p < q && (*p == ' ' || *p == '\t'); p++)
+		;
+	for(; p < q && *p >= '0' && *p <= '9'; p++)
+		dpi = dpi*10 + (*p - '0');
+out:
+	free(reply);
+
+	return dpi;
+}
+
+static uint screen_dpi(void)
+{
+	uint mm = screen->width_in_millimeters;
+
+	if(!mm)
+		return 0;
+
+	return screen->width_in_pixels * 254 / (10*mm);
+}
+
+static void init_scale(void)
+{
+	uint dpi;
+
+	if(!(dpi = xft_dpi()) && !(dpi = screen_dpi()))
+		return;
+
+	scale = (dpi + 48) / 96;
+
+	if(scale < 1)
+		scale = 1;
+	if(scale > MAXSCALE)
+		scale = MAXSCALE;
 }
 
 static void create_window(void)
@@ -78,7 +172,7 @@ static void create_window(void)
 	                  screen->root_depth,
 	                  panwin,
 	                  screen->root,
-	                  0, 0, H, H, 0,
+	                  0, 0, H*scale, H*scale, 0,
 	                  XCB_WINDOW_CLASS_INPUT_OUTPUT,
 			  screen->root_visual,
 	                  mask, values);
@@ -97,54 +191,227 @@ static void create_window(void)
 
 	xcb_map_window(conn, panwin);
 
-	xcb_flush(conn);
+	win_width = H*scale;
+	win_height = H*scale;
+}
+
+/* The image buffer is sized from the actual layout. Allocations are
+   rounded up to whole pages so that small changes in width do not cause
+   reallocations, and the buffer only gets shrunk once more than a page
+   worth of it is left unused.
+
+   Replacing the buffer means a new segment and a new pixmap. The old
+   ones can be dropped right away, the server handles requests in order
+   so any pending copies from the old pixmap are done by the time it
+   gets to the detach. */
+
+static struct shmbuf {
+	xcb_shm_seg_t seg;
+	void* addr;
+	uint size;
+} shmbuf;
+
+static uint page_size(void)
+{
+	return sysconf(_SC_PAGESIZE);
+}
+
+static uint image_size(uint width)
+{
+	uint page = page_size();
+	uint size = width*pix_height*pix_bytes;
+
+	if(!size)
+		return page;
+
+	return (size + page - 1) & ~(page - 1);
+}
+
+static void alloc_image_buf(uint width)
+{
+	uint size = image_size(width);
+	uint line = pix_height*pix_bytes;
+	uint cols = size/line - (size/line) % pix_align;
+	xcb_shm_seg_t seg;
+	xcb_pixmap_t newpix;
+	void* addr;
+	int shmid;
+
+	if((shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0777)) < 0)
+		err(-1, "shmget");
+	if((addr = shmat(shmid, 0, 0)) == (void*)-1) {
+		shmctl(shmid, IPC_RMID, 0);
+		err(-1, "shmat");
+	}
+
+	seg = xcb_generate_id(conn);
+	newpix = xcb_generate_id(conn);
+
+	xcb_shm_attach(conn, seg, shmid, 0);
+
+	xcb_shm_create_pixmap(conn, newpix, panwin, cols, pix_height,
+			screen->root_depth, seg, 0);
+
+	shmctl(shmid, IPC_RMID, 0);
+
+	if(shmbuf.addr) {
+		xcb_free_pixmap(conn, pix);
+		xcb_shm_detach(conn, shmbuf.seg);
+		shmdt(shmbuf.addr);
+	}
+
+	shmbuf.seg = seg;
+	shmbuf.addr = addr;
+	shmbuf.size = size;
+
+	pix = newpix;
+	image = addr;
+	pix_width = cols;
+}
+
+static int image_buf_misfit(void)
+{
+	uint need = image_size(pix_wused);
+
+	if(need > shmbuf.size)
+		return 1;
+	if(need + page_size() < shmbuf.size)
+		return 1;
+
+	return 0;
+}
+
+/* The SHM image uses the native layout of the root visual, so 16-bit
+   displays get half the memory traffic and nothing gets converted per
+   pixel; see setcolor(). Rows must be padded to scanline_pad, which
+   for 16bpp means an even number of columns. */
+
+static const xcb_format_t* find_format(uint depth)
+{
+	const xcb_setup_t* setup = xcb_get_setup(conn);
+	xcb_format_iterator_t it = xcb_setup_pixmap_formats_iterator(setup);
+
+	for(; it.rem; xcb_format_next(&it))
+		if(it.data->depth == depth)
+			return it.data;
+
+	return NULL;
+}
+
+static const xcb_visualtype_t* find_visual(xcb_visualid_t id)
+{
+	xcb_depth_iterator_t di = xcb_screen_allowed_depths_iterator(screen);
+	xcb_visualtype_iterator_t vi;
+
+	for(; di.rem; xcb_depth_next(&di)) {
+		vi = xcb_depth_visuals_iterator(di.data);
+
+		for(; vi.rem; xcb_visualtype_next(&vi))
+			if(vi.data->visual_id == id)
+				return vi.data;
+	}
 
-	win_width = H;
-	win_height = H;
+	return NULL;
+}
+
+static void init_pixfmt(void)
+{
+	const xcb_visualtype_t* vt = find_visual(screen->root_visual);
+	const xcb_format_t* fmt = find_format(screen->root_depth);
+	uint bpp;
+
+	if(!vt || !fmt)
+		errx(-1, "cannot find root visual");
+	if(vt->_class != XCB_VISUAL_CLASS_TRUE_COLOR)
+		errx(-1, "unsupported visual class %i", vt->_class);
+	if((bpp = fmt->bits_per_pixel) != 16 && bpp != 32)
+		errx(-1, "unsupported %i bpp visual", bpp);
+
+	set_pixfmt(vt->red_mask, vt->green_mask, vt->blue_mask, bpp);
+
+	if(fmt->scanline_pad > bpp)
+		pix_align = fmt->scanline_pad / bpp;
 }
 
 static void init_image_buf(void)
 {
 	xcb_shm_query_version_reply_t* reply;
-	xcb_shm_segment_info_t info;
 
-	reply = xcb_shm_query_version_reply(conn,
-			xcb_shm_query_version(conn), NULL);
+	pix_height = H*scale;
+	pix_wused = 0;
+
+	init_pixfmt();
+
+	reply = xcb_shm_query_version_reply(conn, shm_cookie, NULL);
 
 	if(!reply || !reply->shared_pixmaps)
 		errx(-1, "shm error");
 
-	info.shmid = shmget(IPC_PRIVATE, W*H*4, IPC_CREAT | 0777);
-	info.shmaddr = shmat(info.shmid, 0, 0);
-	info.shmseg = xcb_generate_id(conn);
+	free(reply);
 
-	image = (void*)info.shmaddr;
+	alloc_image_buf(W);
+}
 
-	xcb_shm_attach(conn, info.shmseg, info.shmid, 0);
+/* Window updates are deferred until the end of the loop pass.
+   Event handlers only mark the damaged area (or the whole window),
+   and flush_window() then does at most one configure and one copy,
+   clipped to the union of everything damaged during the pass. */
 
-	pix = xcb_generate_id(conn);
+static struct damage {
+	int x0, y0;
+	int x1, y1;
+} damage;
 
-	xcb_shm_create_pixmap(conn, pix, panwin, W, H,
-			screen->root_depth, info.shmseg, 0);
+static void add_damage(int x, int y, int w, int h)
+{
+	struct damage* dm = &damage;
 
-	shmctl(info.shmid, IPC_RMID, 0);
+	if(w <= 0 || h <= 0)
+		return;
 
-	pix_width = W;
-	pix_wused = 0;
-	pix_height = H;
+	if(dm->x1 <= dm->x0) {
+		dm->x0 = x;
+		dm->y0 = y;
+		dm->x1 = x + w;
+		dm->y1 = y + h;
+		return;
+	}
+
+	if(x < dm->x0) dm->x0 = x;
+	if(y < dm->y0) dm->y0 = y;
+	if(x + w > dm->x1) dm->x1 = x + w;
+	if(y + h > dm->y1) dm->y1 = y + h;
 }
 
-static void repaint_window(void)
+static int repaint_window(void)
 {
-	if(!pix_wused) return;
+	struct damage* dm = &damage;
 
-	uint w = pix_wused;
-	uint h = pix_height;
+	int x0 = total_icons;
+	int x1 = total_icons + pix_wused;
+	int y0 = 0;
+	int y1 = pix_height;
+
+	if(dm->x0 > x0) x0 = dm->x0;
+	if(dm->x1 < x1) x1 = dm->x1;
+	if(dm->y0 > y0) y0 = dm->y0;
+	if(dm->y1 < y1) y1 = dm->y1;
+
+	memset(dm, 0, sizeof(*dm));
+
+	if(x1 <= x0 || y1 <= y0)
+		return 0;
+
+	uint sx = x0 - total_icons;
+	uint sy = y0;
 
-	uint x = total_icons;
-	uint y = 0;
+	TRACE4(repaint, x0, y0, x1 - x0, y1 - y0);
 
-	xcb_copy_area(conn, pix, panwin, gc, 0, 0, x, y, w, h);
+	xcb_copy_area(conn, pix, panwin, gc, sx, sy, x0, y0, x1 - x0, y1 - y0);
+
+	copy_outputs(sx, sy, x1 - x0, y1 - y0);
+
+	return 1;
 }
 
 static void resize_window(int width)
@@ -162,12 +429,45 @@ static void resize_window(int width)
 
 void redraw_window(void)
 {
-	int need = total_icons + pix_wused;
+	need_redraw = 1;
+}
+
+static void flush_window(void)
+{
+	if(need_redraw) {
+		int need = total_icons + pix_wused;
+
+		if(need != win_width)
+			resize_window(need);
+
+		resize_outputs(pix_wused);
+
+		add_damage(0, 0, win_width, pix_height);
+
+		need_redraw = 0;
+	}
+
+	uint64_t t0 = stamp();
+
+	if(repaint_window())
+		account(&repaint_probe, t0);
+}
+
+/* Other outputs show the same image without the systray part,
+   their damage gets shifted into panwin coordinates. */
+
+static void handle_expose(xcb_expose_event_t* ev)
+{
+	int dx = 0;
 
-	if(need != win_width)
-		resize_window(need);
+	if(ev->window == panwin)
+		;
+	else if(output_window(ev->window))
+		dx = total_icons;
+	else
+		return;
 
-	repaint_window();
+	add_damage(ev->x + dx, ev->y, ev->width, ev->height);
 }
 
 static void report_error_event(xcb_generic_error_t* evt)
@@ -179,25 +479,59 @@ static void report_error_event(xcb_generic_error_t* evt)
 			evt->error_code);
 }
 
-static void check_xconn(void)
+static void handle_xevent(xcb_generic_event_t* evt)
+{
+	uint type = evt->response_type & 0x7F;
+	void* evp = (void*)evt;
+
+	TRACE1(xevent, type);
+
+	xevents++;
+
+	if(type == 0)
+		report_error_event(evp);
+	if(type == XCB_EXPOSE)
+		handle_expose(evp);
+	if(type == XCB_CLIENT_MESSAGE)
+		handle_client_message(evp);
+	if(type == XCB_REPARENT_NOTIFY)
+		handle_reparent_notify(evp);
+	if(type == XCB_DESTROY_NOTIFY)
+		handle_destroy_notify(evp);
+
+	handle_randr_event(evp);
+	handle_panel_moved(evp);
+
+	free(evt);
+}
+
+/* The X connection is edge-triggered like everything else, so this
+   must drain the socket completely. xcb_poll_for_event() only returns
+   NULL once both the queue and the socket are empty. */
+
+static void check_xconn(void* data, uint events)
 {
 	xcb_generic_event_t* evt;
 
-	while((evt = xcb_poll_for_event(conn))) {
-		uint type = evt->response_type & 0x7F;
-		void* evp = (void*)evt;
-
-		if(type == 0)
-			report_error_event(evp);
-		if(type == XCB_EXPOSE)
-			repaint_window();
-		if(type == XCB_CLIENT_MESSAGE)
-			handle_client_message(evp);
-		if(type == XCB_REPARENT_NOTIFY)
-			handle_reparent_notify(evp);
-		if(type == XCB_DESTROY_NOTIFY)
-			handle_destroy_notify(evp);
-	}
+	if(events & ~EPOLLIN)
+		errx(-1, "lost xconnfd");
+
+	while((evt = xcb_poll_for_event(conn)))
+		handle_xevent(evt);
+
+	if(xcb_connection_has_error(conn))
+		errx(-1, "X connection error");
+}
+
+/* Blocking xcb calls made elsewhere may read events off the socket
+   and queue them without the fd ever being reported ready again. */
+
+static void check_queued_events(void)
+{
+	xcb_generic_event_t* evt;
+
+	while((evt = xcb_poll_for_queued_event(conn)))
+		handle_xevent(evt);
 }
 
 static void update_dtms(void)
@@ -223,30 +557,215 @@ static void update_dtms(void)
 	prevtime = ts;
 }
 
+/* Widgets in the order they appear on the panel, left to right.
+   Updates run in the same order, so whoever owns a shared sample
+   must come before its users (cpuload before sched).
+
+   Widgets with a key function get their output cached in a tile,
+   see tiles.c. For those, render counts misses and blit counts hits. */
+
+#define WIDGET(name, up, key) { #name, up, put_##name, key, \
+	{ #name, "parse" }, { #name, "render" }, { #name, "blit" } }
+
+static struct widget {
+	char* name;
+	void (*update)(void);
+	void (*put)(void);
+	uint64_t (*key)(void);
+	struct probe parse;
+	struct probe render;
+	struct probe blit;
+	struct tile tile;
+} widgets[] = {
+	WIDGET(mailbox,   update_mailbox,   key_mailbox),
+	WIDGET(netload,   update_netload,   NULL),
+	WIDGET(nethealth, update_nethealth, NULL),
+	WIDGET(diskload,  update_diskload,  NULL),
+	WIDGET(cpuload,   update_cpuload,   NULL),
+	WIDGET(sched,     update_sched,     NULL),
+	WIDGET(irqload,   update_irqload,   NULL),
+	WIDGET(proctop,   update_proctop,   NULL),
+	WIDGET(cgroups,   update_cgroups,   NULL),
+	WIDGET(thermal,   update_thermal,   NULL),
+	WIDGET(pressure,  update_pressure,  NULL),
+	WIDGET(memory,    update_memory,    NULL),
+	WIDGET(battery,   update_battery,   key_battery),
+	WIDGET(clock,     NULL,             key_clock),
+	WIDGET(seconds,   NULL,             NULL)
+};
+
+#define NWIDGETS (sizeof(widgets)/sizeof(*widgets))
+
+/* Widgets that read lots of kept fds queue their reads first, so that
+   all of them go in a single batch. */
+
+static void update_stats(void)
+{
+	uint64_t t0 = stamp();
+
+	queue_cgroups();
+	queue_thermal();
+
+	run_batch();
+
+	account(&batch_probe, t0);
+
+	for(uint i = 0; i < NWIDGETS; i++) {
+		struct widget* wg = &widgets[i];
+
+		if(!wg->update)
+			continue;
+
+		TRACE1(parse_start, wg->name);
+
+		t0 = stamp();
+		wg->update();
+		account(&wg->parse, t0);
+
+		TRACE1(parse_done, wg->name);
+	}
+}
+
+/* The part of the image that may differ from what the window shows,
+   in image coordinates. A tile blitted at the same offset as last time
+   is known to be the same, everything else counts as changed. */
+
+static struct span {
+	uint x0;
+	uint x1;
+} changed;
+
+static void mark_changed(uint x0, uint x1)
+{
+	struct span* sp = &changed;
+
+	if(x1 <= x0)
+		return;
+
+	if(sp->x1 <= sp->x0) {
+		sp->x0 = x0;
+		sp->x1 = x1;
+		return;
+	}
+
+	if(x0 < sp->x0) sp->x0 = x0;
+	if(x1 > sp->x1) sp->x1 = x1;
+}
+
+/* Returns the probe the time should go to, render or blit. */
+
+static struct probe* put_widget(struct widget* wg)
+{
+	struct tile* tl = &wg->tile;
+	struct probe* pr = &wg->render;
+	uint x0 = pix_wused;
+	uint64_t key;
+
+	if(!wg->key) {
+		wg->put();
+	} else if(blit_tile(tl, (key = wg->key()))) {
+		pr = &wg->blit;
+
+		if(tl->x == x0)
+			return pr;
+
+		tl->x = x0;
+	} else {
+		wg->put();
+		save_tile(tl, key, x0);
+	}
+
+	mark_changed(x0, pix_wused);
+
+	return pr;
+}
+
+static void render_image(void)
+{
+	clear_image();
+
+	for(uint i = 0; i < NWIDGETS; i++) {
+		struct widget* wg = &widgets[i];
+		uint64_t t0 = stamp();
+
+		TRACE1(render_start, wg->name);
+
+		account(put_widget(wg), t0);
+
+		TRACE1(render_done, wg->name);
+	}
+}
+
+/* Anything drawn past pix_width gets clipped, but pix_wused still
+   accounts for it, so a frame that did not fit is re-rendered once
+   into a properly sized buffer. That second pass is not accounted,
+   the widgets already were for this tick. */
+
+static void rerender_image(void)
+{
+	clear_image();
+
+	for(uint i = 0; i < NWIDGETS; i++)
+		put_widget(&widgets[i]);
+}
+
 static void update_image(void)
 {
+	struct tickrec* tr = begin_tick();
+
+	xevents = 0;
+	memset(&changed, 0, sizeof(changed));
+
 	update_dtms();
-	clear_image();
+	update_stats();
+	update_history();
+	publish_export();
+
+	tr->dtms = dtms;
+	tr->parsed = stamp();
+
+	render_image();
+
+	if(image_buf_misfit()) {
+		alloc_image_buf(pix_wused);
+		rerender_image();
+	}
+
+	tr->rendered = stamp();
 
-	put_mailbox();
-	put_netload();
-	put_cpuload();
-	put_battery();
-	put_clock();
+	account(&frame_probe, tr->start);
 }
 
-static void check_timer(void)
+/* Only the changed span needs to be copied to the window, unless
+   the width changed and everything has to be laid out again. */
+
+static void damage_image(void)
+{
+	struct span* sp = &changed;
+
+	if(total_icons + pix_wused != win_width)
+		redraw_window();
+	else
+		add_damage(total_icons + sp->x0, 0, sp->x1 - sp->x0, pix_height);
+}
+
+static void check_timer(void* data, uint events)
 {
 	byte buf[32];
 	int ret, fd = timer_fd;
 
+	if(events & ~EPOLLIN)
+		errx(-1, "lost timerfd");
+
 	if((ret = read(fd, buf, sizeof(buf))) < 0)
 		err(-1, "read timerfd");
 	if(!ret)
 		return;
 
+	TRACE(tick);
+
 	update_image();
-	redraw_window();
+	damage_image();
 }
 
 static void open_timer_fd(void)
@@ -264,44 +783,105 @@ static void open_timer_fd(void)
 		err(-1, "timerfd_settime");
 
 	timer_fd = fd;
+
+	add_source(fd, EPOLLIN, check_timer, NULL);
 }
 
-static void poll_fds(void)
+static void init_widgets(void)
 {
-	int ret;
-	struct pollfd pfds[2] = {
-		{ .events = POLLIN, .fd = timer_fd },
-		{ .events = POLLIN, .fd = xconn_fd }
-	};
+	init_digits();
+	init_clock();
+	init_mailbox();
+	init_pressure();
+	init_proctop();
+	init_cgroups();
+	init_thermal();
+}
 
-	if((ret = poll(pfds, 2, -1)) < 0)
-		err(-1, "poll");
+/* Whatever the handlers did during a single loop pass, the window
+   gets updated at most once, and the requests get flushed once. */
 
-	if(pfds[0].revents & POLLIN)
-		check_timer();
-	if(pfds[0].revents & ~POLLIN)
-		errx(-1, "lost timerfd");
+static void flush_changes(void)
+{
+	check_queued_events();
+	check_outputs();
 
-	if(pfds[1].revents & POLLIN)
-		check_xconn();
-	if(pfds[1].revents & ~POLLIN)
-		errx(-1, "lost xconnfd");
+	flush_systray();
+	flush_window();
+
+	uint64_t t0 = stamp();
 
 	xcb_flush(conn);
+
+	account(&flush_probe, t0);
+
+	close_tick(xevents);
+}
+
+/* With -t, report how long it took to get the first frame on screen.
+   The extra round trip makes sure the server has actually processed
+   everything sent so far. */
+
+static void init_timing(int argc, char** argv)
+{
+	if(argc > 1 && !strcmp(argv[1], "-t"))
+		timing = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+}
+
+static void report_timing(void)
+{
+	struct timespec ts;
+
+	if(!timing)
+		return;
+
+	free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	uint64_t ns = (ts.tv_sec - t_start.tv_sec)*1000000000ULL
+	            + ts.tv_nsec - t_start.tv_nsec;
+
+	warnx("first frame in %llu.%03llu ms",
+			(unsigned long long)(ns / 1000000),
+			(unsigned long long)(ns / 1000 % 1000));
 }
 
-int main(void)
+/* Startup is arranged so that X requests get sent well before their
+   replies are needed, leaving about one round trip of actual waiting
+   instead of one per request. */
+
+int main(int argc, char** argv)
 {
+	init_timing(argc, argv);
+
 	init_connection();
+	query_systray();
+	init_scale();
 	create_window();
-	init_image_buf();
 	init_systray();
+	query_outputs();
+	init_image_buf();
+	claim_systray();
+	init_outputs();
 
-	init_mailbox();
+	init_widgets();
+	init_stats();
+	init_export();
+	init_history();
 	open_timer_fd();
 
 	update_image();
 	redraw_window();
+	flush_changes();
+
+	check_systray();
+	report_timing();
 
-	while(1) poll_fds();
+	while(1) {
+		flush_changes();
+		poll_sources();
+	}
 }
@@ -1,5 +1,5 @@
-#define W 500
-#define H 20
+#define W 500 /* initial guess, the image gets resized to fit */
+#define H 20 /* at scale 1 */
 
 extern xcb_connection_t* conn;
 extern xcb_screen_t* screen;
@@ -10,7 +10,20 @@ extern xcb_pixmap_t pix;
 extern int total_icons;
 
 void redraw_window(void);
+
+void query_outputs(void);
+void init_outputs(void);
+void check_outputs(void);
+int handle_randr_event(xcb_generic_event_t* ev);
+int handle_panel_moved(xcb_generic_event_t* ev);
+int output_window(xcb_window_t win);
+void resize_outputs(uint width);
+void copy_outputs(int sx, int sy, int w, int h);
+void query_systray(void);
 void init_systray(void);
+void claim_systray(void);
+void check_systray(void);
+void flush_systray(void);
 void handle_client_message(xcb_client_message_event_t* ev);
 void handle_reparent_notify(xcb_reparent_notify_event_t* ev);
 void handle_destroy_notify(xcb_destroy_notify_event_t* ev);
@@ -0,0 +1,229 @@
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Pressure stall graph, cpu/memory/io bands from top to bottom.
+
+   The panel does not poll /proc/pressure on every tick. Instead, each
+   file gets a PSI trigger, and the kernel wakes us up (POLLPRI) only when
+   stall time within the window crosses the threshold. Once woken up,
+   the stall totals get sampled for as long as the trigger keeps firing,
+   and the band goes back to zero-cost idling after that. Healthy system
+   means dark graph and no reads at all.
+
+   Unprivileged triggers must have their windows in multiples of 2s,
+   so that is tried if the 1s one gets rejected. */
+
+#define GRAPHW 60
+#define NPSI 3
+
+#define S scale
+
+#define ACTIVE 3 /* ticks to keep sampling after a trigger */
+
+static struct psi {
+	char* name;
+	uint color;
+	int fd;
+	uint active;
+	uint64_t total; /* us */
+} psis[NPSI] = {
+	{ "/proc/pressure/cpu",    0x007BAC, -1 },
+	{ "/proc/pressure/memory", 0xA91598, -1 },
+	{ "/proc/pressure/io",     0xB4893B, -1 }
+};
+
+static struct psipt {
+	byte band[NPSI];
+} graph[GRAPHW];
+
+static uint graphptr;
+static uint npsi;
+
+static char* triggers[] = {
+	"some 150000 1000000",
+	"some 300000 2000000"
+};
+
+static int read_total(struct psi* ps, uint64_t* total)
+{
+	char buf[128];
+	char *p, *e;
+	int rd;
+
+	if((rd = pread(ps->fd, buf, sizeof(buf) - 1, 0)) <= 0)
+		return -1;
+
+	buf[rd] = '\0';
+	e = buf + rd;
+
+	if(!(p = skip_to_eol(buf, e)))
+		return -1;
+
+	*p = '\0';
+
+	if(!(p = strstr(buf, "total=")))
+		return -1;
+
+	*total = 0;
+
+	if(!parse_add(p + 6, total))
+		return -1;
+
+	return 0;
+}
+
+static void disable_psi(struct psi* ps)
+{
+	close(ps->fd);
+	ps->fd = -1;
+	ps->active = 0;
+}
+
+static void handle_trigger(void* data, uint events)
+{
+	struct psi* ps = data;
+
+	if(ps->fd < 0)
+		return;
+
+	if(events & (EPOLLERR | EPOLLHUP)) {
+		disable_psi(ps);
+		return;
+	}
+
+	if(!ps->active && read_total(ps, &ps->total) < 0) {
+		disable_psi(ps);
+		return;
+	}
+
+	ps->active = ACTIVE;
+}
+
+static int set_trigger(int fd)
+{
+	uint i, n = sizeof(triggers)/sizeof(*triggers);
+
+	for(i = 0; i < n; i++) {
+		char* trig = triggers[i];
+
+		if(write(fd, trig, strlen(trig) + 1) > 0)
+			return 0;
+	}
+
+	return -1;
+}
+
+static void open_psi(struct psi* ps)
+{
+	int fd;
+
+	if((fd = open(ps->name, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+		return;
+
+	if(set_trigger(fd) < 0) {
+		close(fd);
+		return;
+	}
+
+	ps->fd = fd;
+
+	add_source(fd, EPOLLPRI, handle_trigger, ps);
+
+	npsi++;
+}
+
+void init_pressure(void)
+{
+	for(uint i = 0; i < NPSI; i++)
+		open_psi(&psis[i]);
+}
+
+static uint band_height(void)
+{
+	return (pix_height - 2) / NPSI;
+}
+
+/* Stall total is in us and dtms in ms, so the ratio is per mille. */
+
+static uint sample_psi(struct psi* ps)
+{
+	uint64_t total, stall;
+	uint v;
+
+	if(!ps->active)
+		return 0;
+
+	ps->active--;
+
+	if(read_total(ps, &total) < 0)
+		return 0;
+
+	stall = total - ps->total;
+	ps->total = total;
+
+	if(!dtms || !stall)
+		return 0;
+
+	if((v = stall / dtms) > 1000)
+		v = 1000;
+
+	return v;
+}
+
+static uint band_scale(uint v)
+{
+	uint bh = band_height();
+
+	return (bh*v + 999) / 1000; /* anything non-zero is visible */
+}
+
+void update_pressure(void)
+{
+	struct psipt* pt = &graph[graphptr];
+
+	if(!npsi)
+		return;
+
+	for(uint i = 0; i < NPSI; i++) {
+		uint v = sample_psi(&psis[i]);
+
+		pt->band[i] = band_scale(v);
+		xps.psi[i] = v;
+	}
+
+	graphptr = (graphptr + 1) % GRAPHW;
+}
+
+static void redraw_band(uint i, uint y0)
+{
+	uint bh = band_height();
+	uint x, w = GRAPHW;
+
+	setcolor(psis[i].color);
+
+	for(x = 0; x < w; x++) {
+		uint k = (graphptr + x) % GRAPHW;
+		uint v = graph[k].band[i];
+
+		if(v > bh) v = bh;
+
+		fillrec(S*(1 + x), y0 + bh - v, S, v);
+	}
+}
+
+void put_pressure(void)
+{
+	uint bh = band_height();
+
+	if(!npsi)
+		return;
+
+	for(uint i = 0; i < NPSI; i++)
+		redraw_band(i, i*(bh + 1));
+
+	advance(S*(GRAPHW + 2));
+}
@@ -0,0 +1,39 @@
+/* USDT probes for bpftrace/perf, provider "xpanel". Each one is a nop
+   in the code plus an ELF note. The arguments still get computed
+   whether or not a tracer is attached, so they should stay things
+   that are already at hand: variables, not function calls. Without
+   sys/sdt.h they compile to nothing.
+
+   tick                          timer expired, before update_image
+   load_file(path, bytes)        after each whole-file read
+   parse_start(name)             around each widget update
+   parse_done(name)
+   render_start(name)            around each widget put
+   render_done(name)
+   repaint(x, y, w, h)           window area copied from the pixmap
+   xevent(type)                  X event dispatched
+
+   Example:
+
+     bpftrace -e 'usdt:./panel:xpanel:parse_start { @t[tid] = nsecs }
+                  usdt:./panel:xpanel:parse_done /@t[tid]/ {
+                      @us[str(arg0)] = hist((nsecs - @t[tid])/1000) }' */
+
+#if defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define HAVE_SDT
+# endif
+#endif
+
+#ifdef HAVE_SDT
+# define TRACE(name) DTRACE_PROBE(xpanel, name)
+# define TRACE1(name, a) DTRACE_PROBE1(xpanel, name, a)
+# define TRACE2(name, a, b) DTRACE_PROBE2(xpanel, name, a, b)
+# define TRACE4(name, a, b, c, d) DTRACE_PROBE4(xpanel, name, a, b, c, d)
+#else
+# define TRACE(name)
+# define TRACE1(name, a)
+# define TRACE2(name, a, b)
+# define TRACE4(name, a, b, c, d)
+#endif
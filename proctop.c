@@ -0,0 +1,514 @@
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Top CPU consumers since the last tick, as pid + load bar pairs.
+
+   Listing /proc alone takes several ms with 10k processes, so it is not
+   done in one go. Each tick takes one LISTBUF worth of getdents from
+   where the last one stopped, some 250 pids, and reads the stat
+   of every pid in it with open-read-close. Once the listing runs out,
+   the round is complete, pids not seen during it are gone and their
+   slots get freed. A typical desktop takes a round of one or two ticks.
+
+   Processes found to be using CPU get their /proc/[pid]/stat fd kept
+   open, up to MAXFDS of them, and read on every tick in one batch.
+   Once idle, the fd gets closed and the process goes back to being
+   read once per round. So do processes read for the first time, since
+   one read gives no load yet; the next tick tells whether they are busy.
+
+   New processes mostly show up above the highest pid seen so far, and
+   /proc lists pids in order, so on every tick a second fd for /proc
+   gets to list whatever comes after that pid. A new CPU hog is then on
+   the panel within two ticks. An old process waking up only gets noticed
+   within a round, which with 10k processes is about 20s, and so do new
+   ones once pids wrap around. */
+
+#define TOPN 3
+#define MAXFDS 64
+#define LISTBUF 8192
+
+#define S scale
+
+struct proc {
+	int pid; /* 0 for empty slots */
+	int fd;  /* -1 if not kept open */
+	uint seen;
+	uint64_t ticks; /* utime + stime */
+	uint64_t time;  /* ms, 0 if never read */
+	uint load;      /* per mille of one CPU */
+};
+
+struct pdirent {
+	uint64_t ino;
+	int64_t off;
+	unsigned short reclen;
+	unsigned char type;
+	char name[];
+};
+
+static struct proc* procs;
+static uint nslots; /* power of 2 */
+static uint nprocs;
+
+static int procfd = -1;
+static int tailfd = -1; /* for listing pids above maxpid */
+static uint nfds;
+static uint hz;
+
+static uint round;
+static uint64_t now; /* ms */
+
+static int maxpid;
+static int64_t tailoff; /* directory offset of maxpid's entry */
+static int64_t listoff; /* of the next chunk from procfd */
+
+static struct top {
+	int pid;
+	uint load;
+} top[TOPN];
+
+static struct statreq {
+	struct proc* pr;
+	struct readreq rq;
+	char buf[512];
+} reqs[MAXFDS];
+
+static uint hash_pid(int pid)
+{
+	return (uint)pid * 2654435761U;
+}
+
+static struct proc* find_slot(struct proc* table, uint size, int pid)
+{
+	uint mask = size - 1;
+	uint i = hash_pid(pid) & mask;
+
+	while(table[i].pid && table[i].pid != pid)
+		i = (i + 1) & mask;
+
+	return &table[i];
+}
+
+static int grow_table(void)
+{
+	uint size = nslots ? 2*nslots : 1024;
+	struct proc* table;
+	uint i;
+
+	if(!(table = calloc(size, sizeof(*table))))
+		return -1;
+
+	for(i = 0; i < nslots; i++)
+		if(procs[i].pid)
+			*find_slot(table, size, procs[i].pid) = procs[i];
+
+	free(procs);
+
+	procs = table;
+	nslots = size;
+
+	return 0;
+}
+
+/* Backward shift deletion, no tombstones needed with linear probing.
+   Returns 1 if something else got moved into slot i. */
+
+static int remove_slot(uint i)
+{
+	uint mask = nslots - 1;
+	uint j = i, k;
+	int moved = 0;
+
+	while(1) {
+		j = (j + 1) & mask;
+
+		if(!procs[j].pid)
+			break;
+
+		k = hash_pid(procs[j].pid) & mask;
+
+		if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		procs[i] = procs[j];
+		i = j;
+		moved = 1;
+	}
+
+	procs[i].pid = 0;
+	nprocs--;
+
+	return moved;
+}
+
+void init_proctop(void)
+{
+	if((procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+		return;
+
+	tailfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	hz = sysconf(_SC_CLK_TCK);
+}
+
+static int open_stat(int pid)
+{
+	char name[32];
+	char* p = name;
+	char* e = name + sizeof(name) - 1;
+
+	p = fmtint(p, e, pid);
+	p = fmtstr(p, e, "/stat");
+	*p = '\0';
+
+	return openat(procfd, name, O_RDONLY | O_CLOEXEC);
+}
+
+/* pid (comm) S ppid pgrp session tty tpgid flags minflt cminflt majflt
+   cmajflt utime stime ...
+
+   comm may contain anything including spaces and parens, so fields
+   are counted from the last ')'. */
+
+static int parse_stat(char* buf, uint64_t* ticks)
+{
+	char* p;
+
+	if(!(p = strrchr(buf, ')')))
+		return -1;
+
+	p = skip_space(p + 1);
+
+	for(uint i = 0; i < 11; i++)
+		p = skip_field(p);
+
+	*ticks = 0;
+
+	if(!(p = parse_add(p, ticks)))
+		return -1;
+	if(!(p = parse_add(p, ticks)))
+		return -1;
+
+	return 0;
+}
+
+static void add_top(struct proc* pr)
+{
+	uint i, j;
+
+	for(i = 0; i < TOPN; i++)
+		if(top[i].load < pr->load)
+			break;
+	if(i >= TOPN)
+		return;
+
+	for(j = TOPN - 1; j > i; j--)
+		top[j] = top[j-1];
+
+	top[i].pid = pr->pid;
+	top[i].load = pr->load;
+}
+
+/* Ticks going backwards mean the pid got reused since the last read,
+   which is not a load sample either way. */
+
+static void account_proc(struct proc* pr, uint64_t ticks)
+{
+	uint64_t dt, dtck;
+
+	dt = now - pr->time;
+	dtck = ticks - pr->ticks;
+
+	if(!pr->time || !dt || ticks < pr->ticks)
+		pr->load = 0;
+	else
+		pr->load = 1000*1000*dtck / (hz*dt);
+
+	pr->ticks = ticks;
+	pr->time = now;
+
+	add_top(pr);
+}
+
+static void close_stat(struct proc* pr)
+{
+	close(pr->fd);
+	pr->fd = -1;
+	nfds--;
+}
+
+/* A kept fd that fails to read belongs to a process that is gone,
+   even if the pid is back in the listing by now. The slot stays
+   until the end of the round, and gets a fresh start if the pid
+   does show up again. */
+
+static void read_kept(void)
+{
+	uint i, n = 0;
+	uint64_t ticks;
+
+	for(i = 0; i < nslots && n < MAXFDS; i++) {
+		struct proc* pr = &procs[i];
+		struct statreq* sr;
+
+		if(!pr->pid || pr->fd < 0)
+			continue;
+
+		sr = &reqs[n++];
+		sr->pr = pr;
+
+		queue_read(&sr->rq, pr->fd, sr->buf, sizeof(sr->buf));
+	}
+
+	if(!n) return;
+
+	run_batch();
+
+	for(i = 0; i < n; i++) {
+		struct statreq* sr = &reqs[i];
+		struct proc* pr = sr->pr;
+
+		if(sr->rq.ret <= 0 || parse_stat(sr->buf, &ticks) < 0) {
+			close_stat(pr);
+			pr->time = 0;
+			continue;
+		}
+
+		account_proc(pr, ticks);
+
+		if(!pr->load)
+			close_stat(pr);
+	}
+}
+
+static void read_unkept(struct proc* pr)
+{
+	char buf[512];
+	uint64_t ticks;
+	uint fresh = !pr->time;
+	int fd, rd;
+
+	if((fd = open_stat(pr->pid)) < 0)
+		return;
+
+	rd = read(fd, buf, sizeof(buf) - 1);
+
+	if(rd <= 0)
+		goto close;
+
+	buf[rd] = '\0';
+
+	if(parse_stat(buf, &ticks) < 0)
+		goto close;
+
+	account_proc(pr, ticks);
+
+	if(!pr->load && !fresh)
+		goto close;
+	if(nfds >= MAXFDS)
+		goto close;
+
+	pr->fd = fd;
+	nfds++;
+
+	return;
+close:
+	close(fd);
+}
+
+static void check_pid(int pid)
+{
+	struct proc* pr;
+
+	if(2*(nprocs + 1) > nslots && grow_table() < 0)
+		return;
+
+	pr = find_slot(procs, nslots, pid);
+
+	if(!pr->pid) {
+		memset(pr, 0, sizeof(*pr));
+		pr->pid = pid;
+		pr->fd = -1;
+		nprocs++;
+	}
+
+	pr->seen = round;
+
+	/* kept ones got their read already */
+	if(pr->fd < 0 && pr->time != now)
+		read_unkept(pr);
+}
+
+static int parse_pid(char* p)
+{
+	int pid = 0;
+	char c;
+
+	while((c = *p++))
+		if(c >= '0' && c <= '9')
+			pid = pid*10 + (c - '0');
+		else
+			return 0;
+
+	return pid;
+}
+
+static void drop_dead_procs(void)
+{
+	uint i = 0;
+
+	while(i < nslots) {
+		struct proc* pr = &procs[i];
+
+		if(!pr->pid || pr->seen == round) {
+			i++;
+			continue;
+		}
+
+		if(pr->fd >= 0)
+			close_stat(pr);
+
+		if(!remove_slot(i))
+			i++;
+	}
+}
+
+static void end_round(void)
+{
+	drop_dead_procs();
+
+	round++;
+
+	lseek(procfd, 0, SEEK_SET);
+	listoff = 0;
+}
+
+static int list_chunk(int fd, char* buf, uint size)
+{
+	return syscall(SYS_getdents64, fd, buf, size);
+}
+
+/* d_off is where the entry after this one starts, which for the last
+   entry in the directory is just some end mark. So the offset kept for
+   maxpid is that of its own entry, taken from the one before it, and
+   the tail listing starts with maxpid itself. Returns the offset after
+   the chunk. */
+
+static int64_t check_chunk(char* buf, int rd, int64_t off, int minpid)
+{
+	char* p = buf;
+	char* e = buf + rd;
+	int pid;
+
+	while(p < e) {
+		struct pdirent* de = (void*)p;
+
+		if((pid = parse_pid(de->name)) > minpid) {
+			check_pid(pid);
+
+			if(pid > maxpid) {
+				maxpid = pid;
+				tailoff = off;
+			}
+		}
+
+		off = de->off;
+		p += de->reclen;
+	}
+
+	return off;
+}
+
+/* The directory fd keeps its position between ticks. Hitting the end
+   starts the next round right away, so a short listing gets read in
+   full on every tick. */
+
+static void list_procs(void)
+{
+	char buf[LISTBUF] __attribute__((aligned(8)));
+	int rd;
+
+	if(!(rd = list_chunk(procfd, buf, sizeof(buf)))) {
+		end_round();
+		rd = list_chunk(procfd, buf, sizeof(buf));
+	}
+
+	if(rd > 0)
+		listoff = check_chunk(buf, rd, listoff, 0);
+}
+
+/* Usually nothing or a few new pids. A fork storm larger than a chunk
+   gets picked up over the next ticks, tailoff moves along. */
+
+static void list_tail(void)
+{
+	char buf[LISTBUF] __attribute__((aligned(8)));
+	int rd;
+
+	if(tailfd < 0 || !maxpid)
+		return;
+	if(lseek(tailfd, tailoff, SEEK_SET) < 0)
+		return;
+
+	if((rd = list_chunk(tailfd, buf, sizeof(buf))) > 0)
+		check_chunk(buf, rd, tailoff, maxpid);
+}
+
+void update_proctop(void)
+{
+	if(procfd < 0)
+		return;
+
+	now += dtms;
+
+	memset(top, 0, sizeof(top));
+
+	read_kept();
+
+	list_tail();
+	list_procs();
+}
+
+static void draw_top(struct top* tp)
+{
+	char buf[16];
+	char* p = buf;
+	char* e = buf + sizeof(buf) - 1;
+	uint h = pix_height;
+
+	p = fmtint(p, e, tp->pid);
+	*p = '\0';
+
+	uint w = small_width(buf);
+	uint bh = tp->load * h / 1000;
+
+	if(bh > h) bh = h;
+
+	setcolor(0xAAAAAA);
+	moveto(0, (h - small_height())/2);
+	small_string(buf);
+
+	setcolor(0x007BAC);
+	fillrec(w + S, h - bh, 3*S, bh);
+
+	advance(w + S*(1 + 3 + 4));
+}
+
+void put_proctop(void)
+{
+	uint i;
+
+	if(!top[0].load)
+		return;
+
+	advance(2*S);
+
+	for(i = 0; i < TOPN; i++)
+		if(top[i].load)
+			draw_top(&top[i]);
+}
@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <err.h>
+
+#include "common.h"
+
+/* Flight recorder for the last NRECS ticks. Each tick gets a record
+   with a few timestamps and counters, written in place into a ring, so
+   recording is just some stores and is always on.
+
+   The ring gets written out as text on SIGUSR2, and automatically
+   whenever a tick (from the timer firing to the frame being flushed
+   to the server) takes longer than SLOWTICK, or starts SLOWTICK late.
+   The latter catches stalls outside of the tick itself, like the loop
+   being stuck in an X reply or a slow read since the previous one,
+   and leaves both the late tick and the one before it in the ring.
+
+   Automatic dumps are rate-limited so that a box stuck in swap does not
+   also get its disk hammered by the panel. Each dump replaces the
+   previous one. */
+
+#define NRECS 256    /* power of 2 */
+#define SLOWTICK 100 /* ms */
+#define TICKMS 500   /* timer interval, see panel.c */
+#define DUMPGAP 120  /* ticks between automatic dumps */
+
+static struct tickrec recs[NRECS];
+static uint64_t seq;
+static uint64_t lastdump;
+
+static struct tickrec* open_rec;
+static struct iostats iostart;
+
+struct tickrec* begin_tick(void)
+{
+	struct tickrec* tr = &recs[seq % NRECS];
+
+	tr->seq = ++seq;
+	tr->start = stamp();
+	tr->parsed = 0;
+	tr->rendered = 0;
+	tr->flushed = 0;
+	tr->xevents = 0;
+
+	iostart = iostats;
+	open_rec = tr;
+
+	return tr;
+}
+
+/* Only ever under XDG_RUNTIME_DIR. The name is predictable, and in
+   a shared directory like /tmp that would let anyone point it at some
+   other file of ours. */
+
+static char* dump_path(char* buf, uint size)
+{
+	char* dir = getenv("XDG_RUNTIME_DIR");
+	char* p = buf;
+	char* e = buf + size - 1;
+
+	if(!dir || *dir != '/')
+		return NULL;
+
+	p = fmtstr(p, e, dir);
+	p = fmtstr(p, e, "/xpanel.");
+	p = fmtint(p, e, getpid());
+	p = fmtstr(p, e, ".ticks");
+
+	if(p >= e)
+		return NULL;
+
+	*p = '\0';
+
+	return buf;
+}
+
+static uint ms(uint64_t ns)
+{
+	return ns / 1000000;
+}
+
+static uint us(uint64_t from, uint64_t to)
+{
+	return to > from ? (to - from) / 1000 : 0;
+}
+
+static char* fmtsec(char* p, char* e, uint ms)
+{
+	uint frac = ms % 1000;
+
+	p = fmtint(p, e, ms / 1000);
+	p = fmtstr(p, e, frac < 10 ? ".00" : frac < 100 ? ".0" : ".");
+	p = fmtint(p, e, frac);
+
+	return p;
+}
+
+static char* fmtcol(char* p, char* e, uint v)
+{
+	p = fmtstr(p, e, " ");
+	p = fmtint(p, e, v);
+
+	return p;
+}
+
+/* seq and bytes are 64 bit in the record, but neither gets anywhere
+   near 4G within the lifetime of a panel or a single tick. */
+
+static char* fmtrec(char* p, char* e, struct tickrec* tr)
+{
+	p = fmtint(p, e, tr->seq);
+	p = fmtstr(p, e, " ");
+	p = fmtsec(p, e, ms(tr->start));
+	p = fmtcol(p, e, tr->dtms);
+	p = fmtcol(p, e, us(tr->start, tr->parsed));
+	p = fmtcol(p, e, us(tr->parsed, tr->rendered));
+	p = fmtcol(p, e, us(tr->rendered, tr->flushed));
+	p = fmtcol(p, e, us(tr->start, tr->flushed));
+	p = fmtcol(p, e, tr->xevents);
+	p = fmtcol(p, e, tr->bytes);
+	p = fmtcol(p, e, tr->syscalls);
+	p = fmtstr(p, e, "\n");
+
+	return p;
+}
+
+static int flush_buf(int fd, char* buf, char* p)
+{
+	int len = p - buf;
+
+	return write(fd, buf, len) == len ? 0 : -1;
+}
+
+static int write_recs(int fd)
+{
+	char buf[4096];
+	char* p = buf;
+	char* e = buf + sizeof(buf);
+	uint64_t i = seq > NRECS ? seq - NRECS : 0;
+
+	p = fmtstr(p, e, "# seq time dtms parse_us render_us flush_us total_us"
+	                 " xevents bytes syscalls\n");
+
+	for(; i < seq; i++) {
+		if(e - p < 128) {
+			if(flush_buf(fd, buf, p) < 0)
+				return -1;
+			p = buf;
+		}
+
+		p = fmtrec(p, e, &recs[i % NRECS]);
+	}
+
+	return flush_buf(fd, buf, p);
+}
+
+void dump_recorder(void)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC;
+	char path[256];
+	int fd, ret;
+
+	lastdump = seq;
+
+	if(!dump_path(path, sizeof(path))) {
+		warnx("no XDG_RUNTIME_DIR, tick log not written");
+		return;
+	}
+
+	if((fd = open(path, flags, 0600)) < 0)
+		goto fail;
+
+	ret = write_recs(fd);
+
+	if(close(fd) < 0 || ret < 0)
+		goto fail;
+
+	warnx("tick log written to %s", path);
+
+	return;
+fail:
+	warn("%s", path);
+}
+
+/* X events that came in since the tick began are counted towards it,
+   they are what the panel was doing between timer and flush. */
+
+void close_tick(uint xevents)
+{
+	struct tickrec* tr = open_rec;
+	int slow, late;
+
+	if(!tr)
+		return;
+
+	open_rec = NULL;
+
+	tr->flushed = stamp();
+	tr->xevents = xevents;
+	tr->bytes = iostats.bytes - iostart.bytes;
+	tr->syscalls = iostats.syscalls - iostart.syscalls;
+
+	slow = ms(tr->flushed - tr->start) >= SLOWTICK;
+	late = tr->dtms >= TICKMS + SLOWTICK;
+
+	if(!slow && !late)
+		return;
+	if(lastdump && seq - lastdump < DUMPGAP)
+		return;
+
+	dump_recorder();
+}
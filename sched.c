@@ -0,0 +1,81 @@
+#include "common.h"
+
+/* Scheduler activity: context switch rate (log scale, in the back)
+   with runnable and blocked task counts on top, one pixel per task.
+
+   There is no file read here, everything comes from the /proc/stat
+   snapshot cpuload has already parsed during this tick. */
+
+#define GRAPHW 60
+
+#define S scale
+
+static struct schedpt {
+	byte ctxt;
+	byte running;
+	byte blocked;
+} graph[GRAPHW];
+
+static uint graphptr;
+static uint64_t prevctxt;
+static uint primed;
+
+static uint clamp(uint v)
+{
+	uint max = pix_height;
+
+	return v > max ? max : v;
+}
+
+void update_sched(void)
+{
+	struct statsample* ss = &sample.stat;
+	struct schedpt* pt = &graph[graphptr];
+
+	if(!ss->valid)
+		return;
+
+	uint64_t ctxt = ss->ctxt - prevctxt;
+	prevctxt = ss->ctxt;
+
+	if(!primed++)
+		return;
+
+	xps.ctxt = dtms ? ctxt*1000/dtms : 0;
+	xps.running = ss->running;
+	xps.blocked = ss->blocked;
+
+	pt->ctxt = log_scale(ctxt);
+	pt->running = clamp(ss->running);
+	pt->blocked = clamp(ss->blocked);
+
+	graphptr = (graphptr + 1) % GRAPHW;
+}
+
+void put_sched(void)
+{
+	uint i, w = GRAPHW;
+
+	if(!primed)
+		return;
+
+	for(i = 0; i < w; i++) {
+		uint k = (graphptr + i) % GRAPHW;
+		struct schedpt* pt = &graph[k];
+
+		uint run = pt->running;
+		uint blk = pt->blocked;
+		uint x = S*(1 + i);
+
+		setcolor(0x333333);
+		column(x, 0, pt->ctxt);
+
+		setcolor(0x00A800);
+		column(x, 0, run);
+
+		setcolor(0xC03030);
+		column(x, run, run + blk);
+	}
+
+	advance(S*(w + 2));
+}
@@ -0,0 +1,148 @@
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <err.h>
+
+#include "common.h"
+
+/* What the panel itself costs. Anything worth timing gets a probe,
+   and each probe keeps a count, total, worst case and a histogram
+   with power-of-two buckets in microseconds. Probes link themselves
+   into the list on first use, so there is no registration step.
+
+   Syscalls and bytes read through the common file helpers are counted
+   in iostats. SIGUSR1 dumps everything to stderr, and SIGUSR2 writes
+   out the tick recorder. Signals arrive through signalfd so the dumps
+   happen in the main loop like any other event, and never in the middle
+   of something.
+
+   SIGTERM and SIGINT come through the same way, and end up in exit()
+   so that atexit handlers get to clean up after the panel. */
+
+struct iostats iostats;
+
+static struct probe* probes;
+static int sigfd = -1;
+
+uint64_t stamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+static uint bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	uint b = 0;
+
+	while(us && b < NBUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+
+	return b;
+}
+
+void account(struct probe* pr, uint64_t t0)
+{
+	uint64_t dt = stamp() - t0;
+
+	if(!pr->linked) {
+		pr->linked = 1;
+		pr->next = probes;
+		probes = pr;
+	}
+
+	pr->count++;
+	pr->total += dt;
+
+	if(dt > pr->max)
+		pr->max = dt;
+
+	pr->hist[bucket(dt)]++;
+}
+
+/* Buckets are listed by upper bound, "<4:12" means 12 samples took
+   2 to 4 us. The last one has no bound. */
+
+static void dump_probe(struct probe* pr)
+{
+	char buf[256];
+	char* p = buf;
+	char* e = buf + sizeof(buf) - 1;
+	uint i;
+
+	for(i = 0; i < NBUCKETS; i++) {
+		if(!pr->hist[i])
+			continue;
+
+		p = fmtstr(p, e, " ");
+		p = fmtstr(p, e, i < NBUCKETS - 1 ? "<" : ">=");
+		p = fmtint(p, e, i < NBUCKETS - 1 ? 1 << i : 1 << (i - 1));
+		p = fmtstr(p, e, ":");
+		p = fmtint(p, e, pr->hist[i]);
+	}
+
+	*p = '\0';
+
+	warnx("%-8s %-6s n=%llu avg=%lluus max=%lluus%s",
+		pr->name, pr->what,
+		(unsigned long long)pr->count,
+		(unsigned long long)(pr->total / pr->count / 1000),
+		(unsigned long long)(pr->max / 1000),
+		buf);
+}
+
+static void dump_stats(void)
+{
+	struct probe* pr;
+
+	for(pr = probes; pr; pr = pr->next)
+		dump_probe(pr);
+
+	warnx("io syscalls=%llu bytes=%llu",
+		(unsigned long long)iostats.syscalls,
+		(unsigned long long)iostats.bytes);
+}
+
+static void handle_signal(void* data, uint events)
+{
+	struct signalfd_siginfo si;
+	int rd;
+
+	while((rd = read(sigfd, &si, sizeof(si))) > 0)
+		if(si.ssi_signo == SIGTERM || si.ssi_signo == SIGINT)
+			exit(0);
+		else if(si.ssi_signo == SIGUSR2)
+			dump_recorder();
+		else
+			dump_stats();
+
+	if(rd < 0 && errno != EAGAIN)
+		err(-1, "read signalfd");
+}
+
+void init_stats(void)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+
+	if(sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		return;
+	if((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		return;
+
+	add_source(sigfd, EPOLLIN, handle_signal, NULL);
+}
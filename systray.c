@@ -14,14 +14,8 @@
 #include "common.h"
 #include "panel.h"
 
-#define ARRAY_SIZE(a) (sizeof(a)/sizeof(*a))
-
 /* Very simple systray area implementation. Loosely based on tint2 code.
 
-   Fixed number of icon slots, dock requests above that limit are ignored
-   (so the icons will be left floating I guess). Doesn't really matter since
-   for me there's like one, maaaaybe two of them at a time.
-
    tint2 does a lot more things, for unknown reasons, possibly to support
    various client quirks. This was essentially only written to support Wine
    tray icons, so it doest just enough to make Wine icons work. The whole
@@ -30,9 +24,16 @@
    The client windows are wrapped in a container windows (parent window or
    parwin below), which clip them and also provide some degree of isolation
    from the clients. The only interaction with the client-owned icon window
-   is reparenting it, everything else is done on the parwin. */
+   is reparenting it, everything else is done on the parwin.
+
+   Icons are kept in a growable array in the order they appear on the
+   panel, and a hash maps client windows to their positions in the array.
+   Every parwin has SubstructureNotify selected, so there are lots of
+   events for windows that are not icons, and each costs a single hash
+   probe instead of a scan. */
 
 int total_icons;
+static int tray_changed;
 
 struct atoms {
 	int systray_s0;
@@ -45,53 +46,197 @@ struct icon {
 	int parwin;
 	int width;
 	int offset;
-} icons[10];
+};
 
-static struct icon* grab_icon_slot(int cliwin)
+static struct icon* icons;
+static uint nicons; /* including holes left by removed icons */
+static uint maxicons;
+static uint firsthole;
+
+/* Open addressing with linear probing, kept at most half full.
+   Window ids are never 0, so 0 marks free slots. Removal shifts
+   the following entries back instead of leaving tombstones. */
+
+struct slot {
+	int cliwin;
+	uint idx;
+};
+
+static struct slot* hash;
+static uint hashsize;
+static uint hashused;
+
+static uint hash_index(int cliwin)
+{
+	return ((uint)cliwin * 2654435761U) & (hashsize - 1);
+}
+
+static struct slot* hash_find(int cliwin)
 {
-	int i, n = 10;
+	uint i, mask = hashsize - 1;
 
-	for(i = 0; i < n; i++) {
-		struct icon* ico = &icons[i];
+	if(!hashsize)
+		return NULL;
+
+	for(i = hash_index(cliwin); hash[i].cliwin; i = (i + 1) & mask)
+		if(hash[i].cliwin == cliwin)
+			return &hash[i];
+
+	return NULL;
+}
+
+static void hash_put(int cliwin, uint idx)
+{
+	uint i, mask = hashsize - 1;
+
+	for(i = hash_index(cliwin); hash[i].cliwin; i = (i + 1) & mask)
+		;
+
+	hash[i].cliwin = cliwin;
+	hash[i].idx = idx;
+
+	hashused++;
+}
+
+static void hash_del(struct slot* sl)
+{
+	uint i = sl - hash, j = i, k;
+	uint mask = hashsize - 1;
 
-		if(ico->cliwin == cliwin)
-			return NULL;
+	while(hash[j = (j + 1) & mask].cliwin) {
+		k = hash_index(hash[j].cliwin);
+
+		/* entries whose home is cyclically in (i, j] must stay */
+		if(i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		hash[i] = hash[j];
+		i = j;
 	}
 
-	for(i = 0; i < n; i++) {
-		struct icon* ico = &icons[i];
+	hash[i].cliwin = 0;
+	hashused--;
+}
 
-		if(!ico->parwin)
-			return ico;
+static int grow_hash(void)
+{
+	struct slot* old = hash;
+	uint i, oldsize = hashsize;
+	uint size = hashsize ? 2*hashsize : 16;
+
+	if(!(hash = calloc(size, sizeof(*hash)))) {
+		hash = old;
+		return -1;
 	}
 
-	return NULL;
+	hashsize = size;
+	hashused = 0;
+
+	for(i = 0; i < oldsize; i++)
+		if(old[i].cliwin)
+			hash_put(old[i].cliwin, old[i].idx);
+
+	free(old);
+
+	return 0;
+}
+
+static int grow_icons(void)
+{
+	uint max = maxicons ? 2*maxicons : 8;
+	struct icon* ico;
+
+	if(!(ico = realloc(icons, max*sizeof(*ico))))
+		return -1;
+
+	icons = ico;
+	maxicons = max;
+
+	return 0;
+}
+
+static struct icon* grab_icon_slot(int cliwin)
+{
+	struct icon* ico;
+
+	if(hash_find(cliwin))
+		return NULL;
+	if(2*(hashused + 1) > hashsize && grow_hash() < 0)
+		return NULL;
+	if(nicons >= maxicons && grow_icons() < 0)
+		return NULL;
+
+	ico = &icons[nicons];
+
+	memset(ico, 0, sizeof(*ico));
+
+	hash_put(cliwin, nicons++);
+
+	return ico;
 }
 
-static int intern_atom(char* name)
+/* Startup is pipelined to avoid waiting for each reply in turn:
+   the atoms get requested before the panel window is even created,
+   and the ownership check reply is only collected after the image
+   buffer has been set up. See main() for the exact order. */
+
+static struct cookies {
+	xcb_intern_atom_cookie_t systray_s0;
+	xcb_intern_atom_cookie_t systray_opcode;
+	xcb_intern_atom_cookie_t manager;
+	xcb_get_selection_owner_cookie_t owner;
+} cookie;
+
+static xcb_intern_atom_cookie_t query_atom(char* name)
 {
 	int nlen = strlen(name);
 
-	xcb_intern_atom_cookie_t cookie;
+	return xcb_intern_atom(conn, 0, nlen, name);
+}
+
+static int intern_atom(xcb_intern_atom_cookie_t cookie)
+{
 	xcb_intern_atom_reply_t* reply;
 	xcb_generic_error_t* err = NULL;
+	int atom;
 
-	cookie = xcb_intern_atom(conn, 0, nlen, name);
 	reply = xcb_intern_atom_reply(conn, cookie, &err);
 
-	return reply->atom;
+	free(err);
+
+	if(!reply)
+		errx(-1, "cannot intern systray atoms");
+
+	atom = reply->atom;
+
+	free(reply);
+
+	return atom;
+}
+
+static void query_systray_owner(void)
+{
+	cookie.owner = xcb_get_selection_owner(conn, atom.systray_s0);
 }
 
 static int get_systray_owner(void)
 {
-	xcb_get_selection_owner_cookie_t cookie;
 	xcb_get_selection_owner_reply_t* reply;
 	xcb_generic_error_t* err = NULL;
+	int owner;
+
+	reply = xcb_get_selection_owner_reply(conn, cookie.owner, &err);
 
-	cookie = xcb_get_selection_owner(conn, atom.systray_s0);
-	reply = xcb_get_selection_owner_reply(conn, cookie, &err);
+	free(err);
 
-	return reply->owner;
+	if(!reply)
+		errx(-1, "cannot query systray owner");
+
+	owner = reply->owner;
+
+	free(reply);
+
+	return owner;
 }
 
 static void announce_systray(void)
@@ -116,17 +261,34 @@ static void announce_systray(void)
 	xcb_send_event(conn, propagate, dstwin, mask, (void*)&ev);
 }
 
+void query_systray(void)
+{
+	cookie.systray_s0 = query_atom("_NET_SYSTEM_TRAY_S0");
+	cookie.systray_opcode = query_atom("_NET_SYSTEM_TRAY_OPCODE");
+	cookie.manager = query_atom("MANAGER");
+}
+
 void init_systray(void)
 {
-	atom.systray_s0 = intern_atom("_NET_SYSTEM_TRAY_S0");
-	atom.systray_opcode = intern_atom("_NET_SYSTEM_TRAY_OPCODE");
-	atom.manager = intern_atom("MANAGER");
+	atom.systray_s0 = intern_atom(cookie.systray_s0);
+	atom.systray_opcode = intern_atom(cookie.systray_opcode);
+	atom.manager = intern_atom(cookie.manager);
 
+	query_systray_owner();
+}
+
+void claim_systray(void)
+{
 	if(get_systray_owner())
 		errx(-1, "another systray is already running");
 
 	xcb_set_selection_owner(conn, panwin, atom.systray_s0, XCB_CURRENT_TIME);
 
+	query_systray_owner();
+}
+
+void check_systray(void)
+{
 	if(get_systray_owner() != panwin)
 		errx(-1, "cannot claim systray ownership");
 
@@ -148,20 +310,20 @@ static void add_tray_icon(int cliwin)
 	struct icon* ico;
 
 	if(!(ico = grab_icon_slot(cliwin)))
-		return; /* no slots left, ignore request */
+		return; /* already docked, or out of memory */
 
 	uint mask = XCB_CW_BACK_PIXEL;
 	uint values[1] = { screen->black_pixel };
 	int parwin = xcb_generate_id(conn);
 
-	int width = H;
+	int width = pix_height;
 	int offset = total_icons;
 
 	xcb_create_window(conn,
 	                  screen->root_depth,
 	                  parwin,
 	                  panwin,
-	                  offset, 0, width, H, 0,
+	                  offset, 0, width, pix_height, 0,
 	                  XCB_WINDOW_CLASS_INPUT_OUTPUT,
 			  screen->root_visual,
 	                  mask, values);
@@ -193,12 +355,18 @@ static void xcbx_move_window(int win, int x, int y)
 	xcb_configure_window(conn, win, mask, values);
 }
 
-static void recalc_icon_offsets(void)
+/* Icons left of the first hole stay where they are, the rest get
+   shifted left over the holes. */
+
+static void close_holes(void)
 {
-	int i, j = 0, n = ARRAY_SIZE(icons);
+	uint i, j = firsthole;
 	int offset = 0;
 
-	for(i = 0; i < n; i++) {
+	if(j > 0)
+		offset = icons[j-1].offset + icons[j-1].width;
+
+	for(i = firsthole; i < nicons; i++) {
 		struct icon* ico = &icons[i];
 
 		if(!ico->parwin)
@@ -212,27 +380,50 @@ static void recalc_icon_offsets(void)
 		offset += ico->width;
 
 		if(j < i) {
-			icons[j++] = *ico;
-			memset(ico, 0, sizeof(*ico));
-		} else {
-			j++; /* leave it in place */
+			icons[j] = *ico;
+			hash_find(ico->cliwin)->idx = j;
 		}
+
+		j++;
 	}
 
+	nicons = j;
 	total_icons = offset;
 }
 
+/* Several icons may go away within a single loop pass, so the remaining
+   ones only get moved once, from flush_systray(), at the end of the pass. */
+
 static void del_tray_icon(struct icon* ico)
 {
+	struct slot* sl = hash_find(ico->cliwin);
+	uint idx = ico - icons;
+
 	xcb_destroy_window(conn, ico->parwin);
 
+	if(sl)
+		hash_del(sl);
+
 	memset(ico, 0, sizeof(*ico));
 
-	recalc_icon_offsets();
+	if(!tray_changed || idx < firsthole)
+		firsthole = idx;
+
+	tray_changed = 1;
 
 	redraw_window();
 }
 
+void flush_systray(void)
+{
+	if(!tray_changed)
+		return;
+
+	close_holes();
+
+	tray_changed = 0;
+}
+
 void handle_client_message(xcb_client_message_event_t* ev)
 {
 	if(ev->window != panwin)
@@ -252,18 +443,12 @@ void handle_client_message(xcb_client_message_event_t* ev)
 
 static struct icon* find_icon(int cliwin)
 {
-	int i, n = ARRAY_SIZE(icons);
-
-	for(i = 0; i < n; i++) {
-		struct icon* ico = &icons[i];
+	struct slot* sl;
 
-		if(!(ico->parwin))
-			continue;
-		if(ico->cliwin == cliwin)
-			return ico;
-	}
+	if(!(sl = hash_find(cliwin)))
+		return NULL;
 
-	return NULL;
+	return &icons[sl->idx];
 }
 
 void handle_reparent_notify(xcb_reparent_notify_event_t* ev)
@@ -0,0 +1,298 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Hottest thermal zone in small digits, and CPU frequency as a bar
+   (average) with a mark for the fastest core, relative to the highest
+   cpuinfo_max_freq around.
+
+   All the sysfs files are opened once on startup, and the reads get
+   queued in queue_thermal() to go in the same batch with the rest of the
+   tick. With a hundred or more cores that is still too many reads for
+   every tick, so only up to FREQSTEP CPUs get sampled per tick, going
+   round-robin, and the rest keep whatever they had last time. Frequency
+   on an idle core does not change fast enough for it to matter. */
+
+#define MAXZONE 32
+#define FREQSTEP 16
+#define S scale
+#define BARW (4*S)
+
+static struct zone {
+	int fd;
+	struct readreq rq;
+	char buf[16];
+} zones[MAXZONE];
+
+static uint nzones;
+
+static struct cpufreq {
+	int fd;
+	uint khz;
+	struct readreq rq;
+	char buf[16];
+} *cpus;
+
+static uint ncpus;
+static uint cursor;
+static uint nstep;
+static uint maxkhz;
+
+static uint temp;   /* millidegrees C, hottest zone */
+static uint avgkhz;
+static uint topkhz;
+
+static int open_sysfs(char* dir, char* name, char* file)
+{
+	char path[256];
+	char* p = path;
+	char* e = path + sizeof(path) - 1;
+
+	p = fmtstr(p, e, dir);
+	p = fmtstr(p, e, name);
+	p = fmtstr(p, e, file);
+
+	if(p >= e)
+		return -1;
+
+	*p = '\0';
+
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int read_value(int fd, uint* val)
+{
+	char buf[32];
+	int rd;
+
+	if((rd = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+		return -1;
+
+	buf[rd] = '\0';
+
+	return parse_int(buf, val) ? 0 : -1;
+}
+
+static void add_zone(char* name)
+{
+	int fd;
+
+	if(nzones >= MAXZONE)
+		return;
+	if((fd = open_sysfs("/sys/class/thermal/", name, "/temp")) < 0)
+		return;
+
+	zones[nzones++].fd = fd;
+}
+
+static void add_cpu(char* name)
+{
+	static uint size;
+	char* dir = "/sys/devices/system/cpu/";
+	struct cpufreq* cf;
+	uint khz;
+	int fd;
+
+	if((fd = open_sysfs(dir, name, "/cpufreq/cpuinfo_max_freq")) >= 0) {
+		if(read_value(fd, &khz) >= 0 && khz > maxkhz)
+			maxkhz = khz;
+		close(fd);
+	}
+
+	if((fd = open_sysfs(dir, name, "/cpufreq/scaling_cur_freq")) < 0)
+		return;
+
+	if(ncpus >= size) {
+		uint n = size ? 2*size : 64;
+
+		if(!(cf = realloc(cpus, n*sizeof(*cpus)))) {
+			close(fd);
+			return;
+		}
+
+		cpus = cf;
+		size = n;
+	}
+
+	cf = &cpus[ncpus++];
+	cf->fd = fd;
+	cf->khz = 0;
+}
+
+static int numbered(char* name, char* prefix)
+{
+	uint len = strlen(prefix);
+	char c = name[len];
+
+	return !strncmp(name, prefix, len) && c >= '0' && c <= '9';
+}
+
+static void scan_dir(char* path, char* prefix, void (*add)(char* name))
+{
+	struct dirent* de;
+	DIR* dp;
+
+	if(!(dp = opendir(path)))
+		return;
+
+	while((de = readdir(dp)))
+		if(numbered(de->d_name, prefix))
+			add(de->d_name);
+
+	closedir(dp);
+}
+
+void init_thermal(void)
+{
+	scan_dir("/sys/class/thermal", "thermal_zone", add_zone);
+	scan_dir("/sys/devices/system/cpu", "cpu", add_cpu);
+}
+
+void queue_thermal(void)
+{
+	uint i;
+
+	for(i = 0; i < nzones; i++) {
+		struct zone* tz = &zones[i];
+
+		queue_read(&tz->rq, tz->fd, tz->buf, sizeof(tz->buf));
+	}
+
+	nstep = ncpus < FREQSTEP ? ncpus : FREQSTEP;
+
+	for(i = 0; i < nstep; i++) {
+		struct cpufreq* cf = &cpus[(cursor + i) % ncpus];
+
+		queue_read(&cf->rq, cf->fd, cf->buf, sizeof(cf->buf));
+	}
+}
+
+static int parse_value(struct readreq* rq, uint* val)
+{
+	if(rq->ret <= 0)
+		return -1;
+
+	return parse_int(rq->buf, val) ? 0 : -1;
+}
+
+static void sample_zones(void)
+{
+	uint i, val;
+
+	temp = 0;
+
+	for(i = 0; i < nzones; i++)
+		if(parse_value(&zones[i].rq, &val) >= 0 && val > temp)
+			temp = val;
+}
+
+static void sample_cpus(void)
+{
+	uint64_t sum = 0;
+	uint i;
+
+	for(i = 0; i < nstep; i++) {
+		struct cpufreq* cf = &cpus[cursor];
+
+		parse_value(&cf->rq, &cf->khz);
+
+		cursor = (cursor + 1) % ncpus;
+	}
+
+	topkhz = 0;
+
+	for(i = 0; i < ncpus; i++) {
+		uint khz = cpus[i].khz;
+
+		sum += khz;
+
+		if(khz > topkhz)
+			topkhz = khz;
+	}
+
+	avgkhz = sum / ncpus;
+}
+
+void update_thermal(void)
+{
+	if(nzones)
+		sample_zones();
+	if(ncpus)
+		sample_cpus();
+
+	xps.temp = temp;
+	xps.freq_avg = avgkhz;
+	xps.freq_max = topkhz;
+}
+
+static uint temp_color(uint deg)
+{
+	if(deg >= 85)
+		return 0xFF4020;
+	if(deg >= 70)
+		return 0xE0A000;
+
+	return 0xAAAAAA;
+}
+
+static void draw_temp(void)
+{
+	char buf[16];
+	char* p = buf;
+	char* e = buf + sizeof(buf) - 1;
+	uint deg = temp / 1000;
+
+	p = fmtint(p, e, deg);
+	*p = '\0';
+
+	setcolor(temp_color(deg));
+	moveto(0, (pix_height - small_height())/2);
+	small_string(buf);
+
+	advance(small_width(buf) + 2*S);
+}
+
+static uint freq_height(uint khz)
+{
+	uint h = pix_height;
+	uint bh = (uint64_t)khz*h/maxkhz;
+
+	return bh > h ? h : bh;
+}
+
+static void draw_freq(void)
+{
+	uint h = pix_height;
+	uint avg = freq_height(avgkhz);
+	uint top = freq_height(topkhz);
+
+	setcolor(0x333333);
+	fillrec(0, 0, BARW, h);
+
+	setcolor(0x1598A9);
+	fillrec(0, h - avg, BARW, avg);
+
+	if(top) {
+		setcolor(0xFFFFFF);
+		hline(0, h - top, BARW);
+	}
+
+	advance(BARW + 2*S);
+}
+
+void put_thermal(void)
+{
+	if(!temp && !maxkhz)
+		return;
+
+	advance(2*S);
+
+	if(temp)
+		draw_temp();
+	if(maxkhz && ncpus)
+		draw_freq();
+}
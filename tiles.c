@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Render cache for widgets that change rarely. A widget that provides
+   a key function gets its pixels saved into a tile after rendering,
+   and as long as the key stays the same, the tile gets copied back
+   instead of calling put() again. The key must cover everything that
+   affects the output, and nothing else.
+
+   Tiles are saved with the height they were rendered at, a different
+   pix_height is a miss. Frames that got clipped are never saved,
+   image_buf_misfit() will cause a re-render anyway. */
+
+int blit_tile(struct tile* tl, uint64_t key)
+{
+	uint x0 = pix_wused;
+	uint w = tl->w;
+	uint h = tl->h;
+	uint line = w*pix_bytes;
+	uint stride = pix_width*pix_bytes;
+	byte* dst = image + x0*pix_bytes;
+
+	if(!tl->valid || tl->key != key)
+		return 0;
+	if(h != pix_height)
+		return 0;
+	if(x0 + w > pix_width)
+		return 0;
+
+	for(uint r = 0; r < h; r++)
+		memcpy(dst + r*stride, tl->data + r*line, line);
+
+	advance(w);
+
+	return 1;
+}
+
+void save_tile(struct tile* tl, uint64_t key, uint x0)
+{
+	uint w = pix_wused - x0;
+	uint h = pix_height;
+	uint line = w*pix_bytes;
+	uint stride = pix_width*pix_bytes;
+	byte* src = image + x0*pix_bytes;
+	byte* data;
+
+	tl->valid = 0;
+	tl->x = x0;
+
+	if(x0 + w > pix_width)
+		return;
+
+	if(line*h > tl->size) {
+		if(!(data = realloc(tl->data, line*h)))
+			return;
+
+		tl->data = data;
+		tl->size = line*h;
+	}
+
+	for(uint r = 0; r < h; r++)
+		memcpy(tl->data + r*line, src + r*stride, line);
+
+	tl->key = key;
+	tl->w = w;
+	tl->h = h;
+	tl->valid = 1;
+}
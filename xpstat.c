@@ -0,0 +1,191 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+
+#include "xpstat.h"
+
+/* Example reader for the panel stats segment, prints a snapshot
+   every second (or just once with -1).
+
+   The mapping is the only syscall-backed part, everything after that
+   is plain memory reads. */
+
+/* Same name the panel uses, see shm_path() in export.c */
+
+static void stats_path(char* buf, uint size)
+{
+	char* dpy = getenv("DISPLAY");
+	char* p;
+
+	snprintf(buf, size, "/dev/shm/xpanel.%u.%s", getuid(), dpy ? dpy : "");
+
+	for(p = strchr(buf, '.') + 1; *p; p++)
+		if(*p == '/')
+			*p = '_';
+}
+
+static const struct xpstat* map_stats(void)
+{
+	char path[128];
+	struct stat st;
+	void* ptr;
+	int fd;
+
+	stats_path(path, sizeof(path));
+
+	if((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) < 0)
+		err(-1, "%s", path);
+	if(fstat(fd, &st) < 0)
+		err(-1, "stat %s", path);
+	if(st.st_uid != getuid())
+		errx(-1, "%s: not owned by this user", path);
+	if(st.st_size < sizeof(struct xpstat))
+		errx(-1, "%s: too small", path);
+
+	ptr = mmap(NULL, sizeof(struct xpstat), PROT_READ, MAP_SHARED, fd, 0);
+
+	if(ptr == MAP_FAILED)
+		err(-1, "mmap %s", path);
+
+	close(fd);
+
+	return ptr;
+}
+
+/* The seqlock read side. If the writer was in the middle of an update,
+   try again; it only takes as long as a memcpy of the struct. A writer
+   that died or got stopped mid-update leaves seq odd for good, so the
+   number of tries is limited. */
+
+#define TRIES 100000
+
+static void read_stats(const struct xpstat* sh, struct xpstat* xs)
+{
+	uint32_t s0, s1;
+	uint i;
+
+	for(i = 0; i < TRIES; i++) {
+		s0 = __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE);
+
+		if(s0 & 1)
+			continue;
+
+		memcpy(xs, sh, sizeof(*xs));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		s1 = __atomic_load_n(&sh->seq, __ATOMIC_RELAXED);
+
+		if(s0 == s1)
+			return;
+	}
+
+	errx(-1, "panel stuck mid-update");
+}
+
+static uint64_t stamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/* A panel that stopped updating without exiting, SIGSTOP or stuck
+   somewhere, still has a valid header. Missing a few ticks is normal
+   under load, missing a whole second is not. */
+
+static void check_time(struct xpstat* xs)
+{
+	uint64_t now = stamp();
+	uint64_t age = now > xs->time ? (now - xs->time) / 1000000 : 0;
+
+	if(age > xs->dtms + 1000)
+		printf("stale, last update %llu.%03llus ago\n",
+			(unsigned long long)(age / 1000),
+			(unsigned long long)(age % 1000));
+}
+
+static void check_header(struct xpstat* xs)
+{
+	if(xs->magic != XPSTAT_MAGIC)
+		errx(-1, "panel not running or not exporting");
+	if(xs->version != XPSTAT_VERSION)
+		errx(-1, "unsupported version %u", xs->version);
+	if(xs->size < sizeof(*xs))
+		errx(-1, "struct too short");
+}
+
+static void print_stats(struct xpstat* xs)
+{
+	uint i;
+
+	printf("cpu");
+
+	for(i = 0; i < xs->ncpus && i < XPSTAT_MAXCPU; i++)
+		printf(" %u.%u", xs->cpuload[i] / 10, xs->cpuload[i] % 10);
+
+	printf("%%  ctxt %llu/s  run %u blk %u\n",
+		(unsigned long long)xs->ctxt, xs->running, xs->blocked);
+
+	for(i = 0; i < XPSTAT_MAXNET; i++) {
+		struct xpstat_net* xn = &xs->net[i];
+
+		if(!xn->state)
+			continue;
+
+		printf("%.16s rx %llu B/s tx %llu B/s%s\n", xn->name,
+			(unsigned long long)xn->rx,
+			(unsigned long long)xn->tx,
+			xn->state == 2 ? "" : " (down)");
+	}
+
+	printf("disk rd %llu B/s wr %llu B/s util %u.%u%%\n",
+		(unsigned long long)xs->disk_rd,
+		(unsigned long long)xs->disk_wr,
+		xs->disk_util / 10, xs->disk_util % 10);
+
+	printf("mem avail %llu MB of %llu MB  swap in %llu out %llu B/s\n",
+		(unsigned long long)(xs->mem_avail >> 20),
+		(unsigned long long)(xs->mem_total >> 20),
+		(unsigned long long)xs->swap_in,
+		(unsigned long long)xs->swap_out);
+
+	printf("psi cpu %u mem %u io %u  temp %u  freq %u/%u MHz\n",
+		xs->psi[0], xs->psi[1], xs->psi[2],
+		xs->temp / 1000, xs->freq_avg / 1000, xs->freq_max / 1000);
+
+	if(xs->bat_status)
+		printf("battery %u%% %u min\n",
+			xs->bat_charge / 10, xs->bat_minutes);
+}
+
+int main(int argc, char** argv)
+{
+	const struct xpstat* sh = map_stats();
+	int once = (argc > 1 && !strcmp(argv[1], "-1"));
+	struct xpstat xs;
+
+	while(1) {
+		read_stats(sh, &xs);
+		check_header(&xs);
+		check_time(&xs);
+		print_stats(&xs);
+
+		if(once)
+			break;
+
+		printf("\n");
+		fflush(stdout);
+		sleep(1);
+	}
+
+	return 0;
+}
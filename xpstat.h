@@ -0,0 +1,75 @@
+/* Shared memory export of the panel samples.
+
+   The panel writes a struct xpstat into /dev/shm/xpanel.<uid>.<display>
+   once per tick, with any slashes in the display name replaced by '_'.
+   Other tools may map the file read-only and get the same values the
+   panel shows, without reading anything from /proc themselves.
+
+   The segment is protected with a sequence counter. The writer makes
+   seq odd, updates the data, and makes it even again. Readers should
+   copy the struct out, and use the copy only if seq was even and did
+   not change during the copy; see xpstat.c for a complete example.
+   The writer never waits for readers, and readers never make syscalls.
+
+   Layout rules: all fields have fixed sizes, no pointers, natural
+   alignment. New fields only get appended, and readers must check that
+   size covers whatever they want to use. Changes that break the existing
+   layout bump the version. Rates are per second, loads and fractions are
+   per mille, and missing values are zeros. */
+
+#include <stdint.h>
+
+#define XPSTAT_MAGIC   0x54535058 /* "XPST" */
+#define XPSTAT_VERSION 1
+
+#define XPSTAT_MAXCPU 16
+#define XPSTAT_MAXNET 4
+#define XPSTAT_NPSI   3
+
+struct xpstat_net {
+	char name[16];
+	uint32_t state;    /* 0 missing, 1 present, 2 running */
+	uint32_t pad;
+	uint64_t rx;       /* bytes per second */
+	uint64_t tx;
+};
+
+struct xpstat {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;     /* of the struct as written */
+	uint32_t seq;      /* odd while being updated */
+
+	uint64_t time;     /* CLOCK_MONOTONIC ns of the last update */
+	uint32_t dtms;     /* time since the previous update */
+	uint32_t ncpus;
+
+	uint32_t cpuload[XPSTAT_MAXCPU];
+
+	uint64_t ctxt;     /* context switches per second */
+	uint32_t running;
+	uint32_t blocked;
+
+	struct xpstat_net net[XPSTAT_MAXNET];
+
+	uint64_t disk_rd;  /* bytes per second */
+	uint64_t disk_wr;
+	uint32_t disk_util;
+	uint32_t pad0;
+
+	uint64_t mem_total; /* bytes */
+	uint64_t mem_avail;
+	uint64_t mem_cache;
+	uint64_t swap_in;   /* bytes per second */
+	uint64_t swap_out;
+
+	uint32_t psi[XPSTAT_NPSI]; /* cpu memory io, stall per mille */
+	uint32_t temp;      /* millidegrees C, hottest zone */
+	uint32_t freq_avg;  /* kHz */
+	uint32_t freq_max;
+
+	uint32_t bat_status; /* 0 inactive, 1 charging, 2 discharging */
+	uint32_t bat_charge;
+	uint32_t bat_minutes; /* time left while discharging */
+	uint32_t pad1;
+};